@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+
+# Generates a reproducible tree of desktop files, for the benchmarks.
+#
+# The same arguments always give the same tree. The parameters of the corpus
+# are written to corpus.json at the top of the tree, so that an existing
+# corpus can be reused when they did not change. The desktop files that are
+# invalid on purpose are listed in invalid-files.txt, relative to the
+# applications directory.
+
+import argparse
+import json
+import os
+import random
+import shutil
+
+LANGUAGES = [
+    'de', 'fr', 'es', 'it', 'ja', 'zh_CN', 'pt_BR', 'ru', 'pl', 'nl',
+    'sv', 'cs', 'ko', 'tr', 'uk', 'fi', 'da', 'nb', 'hu', 'el',
+]
+
+# (main category, additional categories that can go with it)
+CATEGORIES = [
+    ('AudioVideo', ['Audio', 'Video', 'Player']),
+    ('Development', ['IDE', 'Debugger']),
+    ('Education', ['Math', 'Maps']),
+    ('Game', ['ArcadeGame', 'BoardGame']),
+    ('Graphics', ['2DGraphics', 'Viewer']),
+    ('Network', ['WebBrowser', 'Email', 'Monitor']),
+    ('Office', ['WordProcessor', 'Spreadsheet', 'Viewer']),
+    ('Settings', ['DesktopSettings', 'HardwareSettings', 'PackageManager']),
+    ('System', ['TerminalEmulator', 'Monitor', 'FileTools']),
+    ('Utility', ['TextEditor', 'Archiving', 'Calculator', 'Clock']),
+]
+
+MIME_TYPES = [
+    'application/json', 'application/pdf', 'application/xml',
+    'application/zip', 'application/x-tar', 'application/gzip',
+    'application/vnd.oasis.opendocument.text',
+    'application/vnd.oasis.opendocument.spreadsheet',
+    'audio/flac', 'audio/mpeg', 'audio/ogg', 'audio/x-wav',
+    'image/gif', 'image/jpeg', 'image/png', 'image/svg+xml', 'image/webp',
+    'inode/directory',
+    'text/html', 'text/plain', 'text/x-csrc', 'text/x-python',
+    'video/mp4', 'video/webm', 'video/x-matroska',
+    'x-scheme-handler/http', 'x-scheme-handler/https',
+    'x-scheme-handler/mailto',
+]
+
+# Each broken file has one of these errors
+ERRORS = [
+    'unregistered-key',
+    'invalid-mime-type',
+    'missing-name',
+    'line-without-equal',
+    'unregistered-category',
+]
+
+
+def localized(key, value, languages):
+    lines = ['{}={}'.format(key, value)]
+    for language in languages:
+        lines.append('{}[{}]={} ({})'.format(key, language, value, language))
+    return lines
+
+
+def mime_types(rng, average):
+    count = rng.randint(0, 2 * average) if average > 0 else 0
+    types = set()
+    for _ in range(count):
+        # a fifth of the types are specific to a few applications, like in a
+        # real set of applications
+        if rng.random() < 0.2:
+            types.add('application/x-bench-format-{}'.format(
+                rng.randrange(4 * average + 50)))
+        else:
+            types.add(rng.choice(MIME_TYPES))
+    return sorted(types)
+
+
+def desktop_file(rng, index, args):
+    """Returns the contents of the file, and whether it is invalid"""
+    name = 'Bench Application {}'.format(index)
+    languages = rng.sample(LANGUAGES, min(args.translations, len(LANGUAGES)))
+    main, additional = rng.choice(CATEGORIES)
+    categories = [main] + rng.sample(additional,
+                                     rng.randint(0, min(args.categories,
+                                                        len(additional))))
+    types = mime_types(rng, args.mime_types)
+    error = rng.choice(ERRORS) if rng.random() < args.error_rate else None
+
+    lines = ['[Desktop Entry]', 'Type=Application']
+    if error != 'missing-name':
+        lines += localized('Name', name, languages)
+    lines += localized('GenericName', 'Benchmark Tool', languages)
+    lines += localized('Comment', 'Open files with {}'.format(name),
+                       languages)
+    lines += [
+        'Exec=bench-app-{} %U'.format(index),
+        'Icon=bench-app-{}'.format(index),
+        'Terminal=false',
+        'StartupNotify=true',
+    ]
+
+    if error == 'unregistered-category':
+        categories.append('BenchCategory')
+    lines.append('Categories={};'.format(';'.join(categories)))
+
+    if error == 'invalid-mime-type':
+        types.append('not-a-mime-type')
+    if types:
+        lines.append('MimeType={};'.format(';'.join(types)))
+
+    lines.append('Keywords=bench;tool{};'.format(index))
+    for language in languages:
+        lines.append('Keywords[{}]=bench;tool{};{};'.format(language, index,
+                                                          language))
+
+    if error == 'unregistered-key':
+        lines.append('BenchKey=true')
+    if error == 'line-without-equal':
+        lines.append('this line has no equal sign')
+
+    # some applications should not be listed
+    if rng.random() < 0.02:
+        lines.append('Hidden=true')
+    elif rng.random() < 0.05:
+        lines.append('NoDisplay=true')
+
+    if rng.random() < 0.3:
+        lines.append('Actions=new-window;')
+        lines.append('')
+        lines.append('[Desktop Action new-window]')
+        lines += localized('Name', 'New Window', languages)
+        lines.append('Exec=bench-app-{} --new-window'.format(index))
+
+    return '\n'.join(lines) + '\n', error is not None
+
+
+def subdirectory(rng, depth):
+    levels = rng.randint(0, depth)
+    return os.path.join(*['vendor{}'.format(rng.randrange(4))
+                          for _ in range(levels)]) if levels else ''
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate a corpus of '
+                                     'desktop files for the benchmarks')
+    parser.add_argument('output', help='directory of the corpus')
+    parser.add_argument('--count', type=int, default=2000,
+                        help='number of desktop files')
+    parser.add_argument('--translations', type=int, default=8,
+                        help='number of languages of each localized key')
+    parser.add_argument('--mime-types', type=int, default=4,
+                        help='average number of MIME types per file')
+    parser.add_argument('--categories', type=int, default=2,
+                        help='maximum number of additional categories')
+    parser.add_argument('--depth', type=int, default=2,
+                        help='maximum depth of subdirectories')
+    parser.add_argument('--error-rate', type=float, default=0.05,
+                        help='proportion of invalid files')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    parameters = {key: value for key, value in vars(args).items()
+                  if key != 'output'}
+    stamp = os.path.join(args.output, 'corpus.json')
+    invalid_list = os.path.join(args.output, 'invalid-files.txt')
+
+    try:
+        with open(stamp, encoding='utf-8') as f:
+            # corpora generated before the list existed are generated again
+            if json.load(f) == parameters and os.path.exists(invalid_list):
+                return
+    except (OSError, ValueError):
+        # never remove a directory that was not created here
+        if os.path.exists(args.output) and os.listdir(args.output):
+            raise SystemExit('{} is not empty and is not a corpus'.format(
+                args.output))
+
+    shutil.rmtree(args.output, ignore_errors=True)
+    applications = os.path.join(args.output, 'applications')
+    os.makedirs(applications)
+
+    rng = random.Random(args.seed)
+    invalid = []
+    for index in range(args.count):
+        directory = os.path.join(applications,
+                                 subdirectory(rng, args.depth))
+        os.makedirs(directory, exist_ok=True)
+        path = os.path.join(directory,
+                            'org.bench.App{}.desktop'.format(index))
+        contents, is_invalid = desktop_file(rng, index, args)
+        with open(path, 'w', encoding='utf-8') as f:
+            f.write(contents)
+        if is_invalid:
+            invalid.append(os.path.relpath(path, applications))
+
+    with open(invalid_list, 'w', encoding='utf-8') as f:
+        f.writelines(path + '\n' for path in sorted(invalid))
+
+    # written last: an interrupted generation is not reused
+    with open(stamp, 'w', encoding='utf-8') as f:
+        json.dump(parameters, f)
+
+
+if __name__ == '__main__':
+    main()
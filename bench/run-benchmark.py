@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+
+# Runs one of the tools over the benchmark corpus and reports the time of
+# each run as a JSON object, on the standard output and appended to the
+# results file if any.
+#
+# Usage: run-benchmark.py [OPTION...] -- TOOL [ARGUMENT...]
+#
+# In the arguments of the tool, @APPLICATIONS@ is replaced by the directory
+# of desktop files of the corpus, @FILES@ by all the desktop files,
+# @VALID_FILES@ by the desktop files that are not invalid on purpose, and
+# @DEST@ by an empty temporary directory.
+
+import argparse
+import json
+import os
+import resource
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# Written by update-desktop-database in the directory it updates
+DATABASE_FILES = ['mimeinfo.cache', 'mimeinfo.idx', '.mimeinfo.manifest']
+
+
+def desktop_files(applications):
+    files = []
+    for root, dirs, names in os.walk(applications):
+        dirs.sort()
+        files += [os.path.join(root, name) for name in sorted(names)
+                  if name.endswith('.desktop')]
+    return files
+
+
+def invalid_files(corpus, applications):
+    with open(os.path.join(corpus, 'invalid-files.txt'),
+              encoding='utf-8') as f:
+        return {os.path.join(applications, line.rstrip('\n'))
+                for line in f if line.strip()}
+
+
+def expand(arguments, applications, files, valid_files, dest):
+    command = []
+    for argument in arguments:
+        if argument == '@FILES@':
+            command += files
+        elif argument == '@VALID_FILES@':
+            command += valid_files
+        else:
+            command.append(argument.replace('@APPLICATIONS@', applications)
+                           .replace('@DEST@', dest))
+    return command
+
+
+def clean_database(applications):
+    for name in DATABASE_FILES:
+        try:
+            os.unlink(os.path.join(applications, name))
+        except FileNotFoundError:
+            pass
+
+
+def run(command):
+    before = resource.getrusage(resource.RUSAGE_CHILDREN)
+    start = time.perf_counter()
+    process = subprocess.run(command, stdout=subprocess.DEVNULL,
+                             stderr=subprocess.DEVNULL)
+    wall = time.perf_counter() - start
+    after = resource.getrusage(resource.RUSAGE_CHILDREN)
+
+    return {
+        'wall_s': round(wall, 6),
+        'user_s': round(after.ru_utime - before.ru_utime, 6),
+        'sys_s': round(after.ru_stime - before.ru_stime, 6),
+        'exit_status': process.returncode,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Run a benchmark')
+    parser.add_argument('--name', required=True, help='name of the benchmark')
+    parser.add_argument('--generator', required=True,
+                        help='path of gen-corpus.py')
+    parser.add_argument('--corpus', required=True,
+                        help='directory of the corpus')
+    parser.add_argument('--count', type=int, default=2000,
+                        help='number of desktop files in the corpus')
+    parser.add_argument('--repeat', type=int, default=5,
+                        help='number of measured runs')
+    parser.add_argument('--keep-database', action='store_true',
+                        help='do not remove the files written by '
+                        'update-desktop-database between runs')
+    parser.add_argument('--allowed-status', type=int, action='append',
+                        default=[0], help='exit status that is not a failure')
+    parser.add_argument('--output', help='file the results are appended to')
+    parser.add_argument('command', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    command = args.command
+    if command and command[0] == '--':
+        command = command[1:]
+    if not command:
+        parser.error('no command to run')
+
+    subprocess.run([sys.executable, args.generator, args.corpus,
+                    '--count', str(args.count)], check=True)
+    with open(os.path.join(args.corpus, 'corpus.json'),
+              encoding='utf-8') as f:
+        corpus = json.load(f)
+
+    applications = os.path.join(args.corpus, 'applications')
+    files = desktop_files(applications)
+    invalid = invalid_files(args.corpus, applications)
+    valid_files = [path for path in files if path not in invalid]
+
+    # the first run is not measured: it fills the page cache and, with
+    # --keep-database, writes the files used by the next runs
+    runs = []
+    for i in range(args.repeat + 1):
+        if not args.keep_database:
+            clean_database(applications)
+
+        dest = tempfile.mkdtemp(prefix='desktop-file-utils-bench-')
+        try:
+            result = run(expand(command, applications, files, valid_files,
+                                dest))
+        finally:
+            shutil.rmtree(dest)
+
+        if result['exit_status'] not in args.allowed_status:
+            sys.exit('{}: {} exited with status {}'.format(
+                args.name, os.path.basename(command[0]),
+                result['exit_status']))
+
+        if i > 0:
+            runs.append(result)
+
+    clean_database(applications)
+
+    walls = [result['wall_s'] for result in runs]
+    report = {
+        'benchmark': args.name,
+        'tool': os.path.basename(command[0]),
+        'arguments': [argument for argument in command[1:]
+                      if argument not in ('@FILES@', '@VALID_FILES@')],
+        'corpus': corpus,
+        'runs': runs,
+        'min_wall_s': min(walls),
+        'median_wall_s': statistics.median(walls),
+        'max_wall_s': max(walls),
+    }
+
+    line = json.dumps(report, sort_keys=True)
+    print(line)
+    if args.output:
+        with open(args.output, 'a', encoding='utf-8') as f:
+            f.write(line + '\n')
+
+
+if __name__ == '__main__':
+    main()
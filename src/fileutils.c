@@ -0,0 +1,468 @@
+/* fileutils.c: helpers to read files
+ * vim: set ts=2 sw=2 et: */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "fileutils.h"
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#define DFU_READ_SIZE 4096
+
+/* Most desktop files fit in the first read of a batch */
+#define DFU_BATCH_READ_SIZE 16384
+
+/* The content of a file: regular files are mapped in memory, while other
+ * files (pipes, character devices, ...) and files read in a batch are read
+ * into a buffer */
+struct _DfuFileContents
+{
+  GMappedFile *mapped;
+  GByteArray  *buffer;
+};
+
+static GByteArray *
+read_from_fd (int      fd,
+              GError **error)
+{
+  GByteArray *buffer;
+  guint8      read_buf[DFU_READ_SIZE];
+  gssize      bytes_read;
+
+  buffer = g_byte_array_new ();
+
+  while (1) {
+    bytes_read = read (fd, read_buf, DFU_READ_SIZE);
+
+    if (bytes_read == 0)  /* End of File */
+      break;
+
+    if (bytes_read < 0) {
+      int saved_errno = errno;
+
+      if (saved_errno == EINTR || saved_errno == EAGAIN)
+        continue;
+
+      g_set_error_literal (error, G_FILE_ERROR,
+                           g_file_error_from_errno (saved_errno),
+                           g_strerror (saved_errno));
+      g_byte_array_free (buffer, TRUE);
+      return NULL;
+    }
+
+    g_byte_array_append (buffer, read_buf, bytes_read);
+  }
+
+  return buffer;
+}
+
+DfuFileContents *
+dfu_file_contents_new_from_fd (int      fd,
+                               GError **error)
+{
+  DfuFileContents *contents;
+  struct stat      stat_buf;
+
+  g_return_val_if_fail (fd >= 0, NULL);
+
+  if (fstat (fd, &stat_buf) < 0) {
+    int saved_errno = errno;
+
+    g_set_error_literal (error, G_FILE_ERROR,
+                         g_file_error_from_errno (saved_errno),
+                         g_strerror (saved_errno));
+    return NULL;
+  }
+
+  contents = g_slice_new0 (DfuFileContents);
+
+  /* the size of some regular files (in /proc, for example) is not known in
+   * advance, so those are read too */
+  if (S_ISREG (stat_buf.st_mode) && stat_buf.st_size > 0) {
+    contents->mapped = g_mapped_file_new_from_fd (fd, FALSE, NULL);
+    if (contents->mapped != NULL)
+      return contents;
+    /* some file systems do not support mmap() */
+  }
+
+  contents->buffer = read_from_fd (fd, error);
+  if (contents->buffer == NULL) {
+    g_slice_free (DfuFileContents, contents);
+    return NULL;
+  }
+
+  return contents;
+}
+
+DfuFileContents *
+dfu_file_contents_new (const char  *filename,
+                       GError     **error)
+{
+  DfuFileContents *contents;
+  int              fd;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  fd = g_open (filename, O_RDONLY, 0);
+  if (fd < 0) {
+    int saved_errno = errno;
+
+    g_set_error_literal (error, G_FILE_ERROR,
+                         g_file_error_from_errno (saved_errno),
+                         g_strerror (saved_errno));
+    return NULL;
+  }
+
+  contents = dfu_file_contents_new_from_fd (fd, error);
+  close (fd);
+
+  return contents;
+}
+
+const char *
+dfu_file_contents_get_data (DfuFileContents *contents)
+{
+  g_return_val_if_fail (contents != NULL, NULL);
+
+  if (contents->mapped != NULL)
+    return g_mapped_file_get_contents (contents->mapped);
+
+  return (const char *) contents->buffer->data;
+}
+
+gsize
+dfu_file_contents_get_length (DfuFileContents *contents)
+{
+  g_return_val_if_fail (contents != NULL, 0);
+
+  if (contents->mapped != NULL)
+    return g_mapped_file_get_length (contents->mapped);
+
+  return contents->buffer->len;
+}
+
+void
+dfu_file_contents_free (DfuFileContents *contents)
+{
+  if (contents == NULL)
+    return;
+
+  if (contents->mapped != NULL)
+    g_mapped_file_unref (contents->mapped);
+  if (contents->buffer != NULL)
+    g_byte_array_free (contents->buffer, TRUE);
+
+  g_slice_free (DfuFileContents, contents);
+}
+
+static void
+set_error_from_errno (GError **error,
+                      int      saved_errno)
+{
+  g_set_error_literal (error, G_FILE_ERROR,
+                       g_file_error_from_errno (saved_errno),
+                       g_strerror (saved_errno));
+}
+
+#ifdef HAVE_LIBURING
+
+/* The ring is created on first use, and kept for the next batches */
+static struct io_uring ring;
+static int             ring_state = 0;  /* 1 if usable, -1 if not */
+
+/* Result of a request that did not run */
+#define RING_NOT_RUN G_MININT
+
+static gboolean
+ring_init (void)
+{
+  struct io_uring_probe *probe;
+
+  if (ring_state != 0)
+    return ring_state > 0;
+
+  ring_state = -1;
+  if (io_uring_queue_init (DFU_BATCH_SIZE, &ring, 0) < 0)
+    return FALSE;
+
+  /* io_uring can only open, read and close files since Linux 5.6; before
+   * that, the requests would all fail with EINVAL */
+  probe = io_uring_get_probe_ring (&ring);
+  if (probe != NULL &&
+      io_uring_opcode_supported (probe, IORING_OP_OPENAT) &&
+      io_uring_opcode_supported (probe, IORING_OP_READ) &&
+      io_uring_opcode_supported (probe, IORING_OP_CLOSE))
+    ring_state = 1;
+  else
+    io_uring_queue_exit (&ring);
+
+  if (probe != NULL)
+    io_uring_free_probe (probe);
+
+  return ring_state > 0;
+}
+
+/* Submits the @n_requests prepared requests and stores the result of each
+ * in @results, indexed by their user data; the result of a request that did
+ * not run is left untouched. Interrupted system calls are restarted; after
+ * any other error, the ring is not used anymore. The submitted requests are
+ * always waited for, unless waiting fails too: then @in_flight is set, as
+ * those requests may still complete at any time. */
+static void
+ring_run (guint     n_requests,
+          int      *results,
+          gboolean *in_flight)
+{
+  struct io_uring_cqe *cqe;
+  guint                n_submitted;
+  guint                n_completed;
+  int                  ret;
+
+  *in_flight = FALSE;
+
+  n_submitted = 0;
+  while (n_submitted < n_requests) {
+    ret = io_uring_submit (&ring);
+    if (ret == -EINTR)
+      continue;
+    if (ret <= 0)
+      break;
+    n_submitted += ret;
+  }
+
+  n_completed = 0;
+  while (n_completed < n_submitted) {
+    ret = io_uring_wait_cqe (&ring, &cqe);
+    if (ret == -EINTR)
+      continue;
+    if (ret < 0) {
+      *in_flight = TRUE;
+      break;
+    }
+    results[cqe->user_data] = cqe->res;
+    io_uring_cqe_seen (&ring, cqe);
+    n_completed++;
+  }
+
+  if (n_completed < n_requests)
+    ring_state = -1;
+}
+
+/* The first read may not be enough for big files */
+static gboolean
+read_remaining (int          fd,
+                GByteArray  *buffer,
+                GError     **error)
+{
+  guint8 read_buf[DFU_READ_SIZE];
+  gssize bytes_read;
+
+  while ((bytes_read = pread (fd, read_buf, DFU_READ_SIZE, buffer->len)) != 0) {
+    if (bytes_read < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      set_error_from_errno (error, errno);
+      return FALSE;
+    }
+
+    g_byte_array_append (buffer, read_buf, bytes_read);
+  }
+
+  return TRUE;
+}
+
+/* Opens, reads and closes up to DFU_BATCH_SIZE files with three submissions
+ * to the ring, instead of three system calls per file. Whatever the ring
+ * did not do, because it stopped working, is done with system calls. */
+static void
+read_batch_uring (int                 dir_fd,
+                  const char * const *paths,
+                  guint               n_paths,
+                  DfuFileContents   **contents,
+                  GError            **errors)
+{
+  struct io_uring_sqe *sqe;
+  GByteArray          *buffers[DFU_BATCH_SIZE];
+  int                  fds[DFU_BATCH_SIZE];
+  int                  results[DFU_BATCH_SIZE];
+  gboolean             in_flight;
+  guint                n_requests;
+  guint                i;
+
+  n_requests = 0;
+  for (i = 0; i < n_paths; i++) {
+    fds[i] = RING_NOT_RUN;
+
+    sqe = io_uring_get_sqe (&ring);
+    if (sqe == NULL)
+      continue;
+    io_uring_prep_openat (sqe, dir_fd, paths[i], O_RDONLY | O_CLOEXEC, 0);
+    io_uring_sqe_set_data64 (sqe, i);
+    n_requests++;
+  }
+
+  ring_run (n_requests, fds, &in_flight);
+
+  /* a file opened by a request still in flight is leaked, but opening it
+   * again is safe */
+  for (i = 0; i < n_paths; i++) {
+    if (fds[i] != RING_NOT_RUN)
+      continue;
+    fds[i] = openat (dir_fd, paths[i], O_RDONLY | O_CLOEXEC);
+    if (fds[i] < 0)
+      fds[i] = -errno;
+  }
+
+  n_requests = 0;
+  for (i = 0; i < n_paths; i++) {
+    buffers[i] = NULL;
+    results[i] = RING_NOT_RUN;
+    if (fds[i] < 0 || ring_state < 0)
+      continue;
+
+    sqe = io_uring_get_sqe (&ring);
+    if (sqe == NULL)
+      continue;
+
+    buffers[i] = g_byte_array_sized_new (DFU_BATCH_READ_SIZE);
+    g_byte_array_set_size (buffers[i], DFU_BATCH_READ_SIZE);
+
+    io_uring_prep_read (sqe, fds[i], buffers[i]->data, DFU_BATCH_READ_SIZE, 0);
+    io_uring_sqe_set_data64 (sqe, i);
+    n_requests++;
+  }
+
+  ring_run (n_requests, results, &in_flight);
+
+  for (i = 0; i < n_paths; i++) {
+    if (fds[i] < 0) {
+      contents[i] = NULL;
+      set_error_from_errno (&errors[i], -fds[i]);
+    } else if (results[i] == RING_NOT_RUN) {
+      /* the kernel may still write into the buffer of a read in flight, so
+       * it is leaked then */
+      if (buffers[i] != NULL && !in_flight)
+        g_byte_array_free (buffers[i], TRUE);
+      contents[i] = dfu_file_contents_new_from_fd (fds[i], &errors[i]);
+    } else if (results[i] < 0) {
+      contents[i] = NULL;
+      set_error_from_errno (&errors[i], -results[i]);
+      g_byte_array_free (buffers[i], TRUE);
+    } else {
+      g_byte_array_set_size (buffers[i], results[i]);
+
+      if (results[i] == DFU_BATCH_READ_SIZE &&
+          !read_remaining (fds[i], buffers[i], &errors[i])) {
+        contents[i] = NULL;
+        g_byte_array_free (buffers[i], TRUE);
+      } else {
+        contents[i] = g_slice_new0 (DfuFileContents);
+        contents[i]->buffer = buffers[i];
+      }
+    }
+  }
+
+  n_requests = 0;
+  for (i = 0; i < n_paths; i++) {
+    results[i] = RING_NOT_RUN;
+    if (fds[i] < 0)
+      continue;
+
+    sqe = ring_state > 0 ? io_uring_get_sqe (&ring) : NULL;
+    if (sqe == NULL) {
+      results[i] = close (fds[i]);
+      continue;
+    }
+    io_uring_prep_close (sqe, fds[i]);
+    io_uring_sqe_set_data64 (sqe, i);
+    n_requests++;
+  }
+
+  ring_run (n_requests, results, &in_flight);
+
+  /* closing a descriptor that a close in flight may close too could close
+   * another file opened in the meantime: those are leaked instead */
+  if (!in_flight) {
+    for (i = 0; i < n_paths; i++)
+      if (fds[i] >= 0 && results[i] == RING_NOT_RUN)
+        close (fds[i]);
+  }
+}
+
+#endif /* HAVE_LIBURING */
+
+/* Reads many small files, relative to @dir_fd, with as few system calls as
+ * possible using io_uring. The result for @paths[i] is @contents[i], or
+ * @errors[i] (which must be initialized to NULL) if the file could not be
+ * read. This must only be used from one thread.
+ *
+ * Returns FALSE when batched reads are not available: nothing was read, and
+ * the files must be read one by one. */
+gboolean
+dfu_file_contents_read_batch (int                 dir_fd,
+                              const char * const *paths,
+                              guint               n_paths,
+                              DfuFileContents   **contents,
+                              GError            **errors)
+{
+#ifdef HAVE_LIBURING
+  guint i;
+
+  if (!ring_init ())
+    return FALSE;
+
+  for (i = 0; i < n_paths && ring_state > 0; i += DFU_BATCH_SIZE)
+    read_batch_uring (dir_fd, paths + i, MIN (DFU_BATCH_SIZE, n_paths - i),
+                      contents + i, errors + i);
+
+  /* the ring stopped working: read the rest one by one */
+  for (; i < n_paths; i++) {
+    int fd;
+
+    fd = openat (dir_fd, paths[i], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      contents[i] = NULL;
+      set_error_from_errno (&errors[i], errno);
+      continue;
+    }
+
+    contents[i] = dfu_file_contents_new_from_fd (fd, &errors[i]);
+    close (fd);
+  }
+
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
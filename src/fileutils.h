@@ -0,0 +1,49 @@
+/* fileutils.h: helpers to read files
+ * vim: set ts=2 sw=2 et: */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __DFU_FILEUTILS_H__
+#define __DFU_FILEUTILS_H__
+
+#include <glib.h>
+
+typedef struct _DfuFileContents DfuFileContents;
+
+/* Number of files dfu_file_contents_read_batch() reads at once */
+#define DFU_BATCH_SIZE 64
+
+DfuFileContents *dfu_file_contents_new         (const char  *filename,
+                                                GError     **error);
+
+DfuFileContents *dfu_file_contents_new_from_fd (int          fd,
+                                                GError     **error);
+
+const char      *dfu_file_contents_get_data    (DfuFileContents *contents);
+
+gsize            dfu_file_contents_get_length  (DfuFileContents *contents);
+
+void             dfu_file_contents_free        (DfuFileContents *contents);
+
+gboolean         dfu_file_contents_read_batch  (int                 dir_fd,
+                                                const char * const *paths,
+                                                guint               n_paths,
+                                                DfuFileContents   **contents,
+                                                GError            **errors);
+
+#endif /* __DFU_FILEUTILS_H__ */
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+
+# Generates minimal perfect hashes for the tables of registered names in
+# validate.c, so that the validator can look up a key, a category or a
+# desktop environment with a single string comparison.
+#
+# The hash is a two-level "hash and displace" scheme: the FNV-1a hash (with a
+# final mix) of the name with a seed of 0 selects a bucket, and the seed
+# stored for that bucket gives the final slot. The C side of this lives in
+# validate.c and must be kept in sync with fnv1a() below.
+
+import re
+import sys
+
+TABLES = [
+    # (name of the table in validate.c, whether entries are structures)
+    ('registered_desktop_keys', True),
+    ('registered_action_keys', True),
+    ('show_in_registered', False),
+    ('registered_categories', True),
+]
+
+STRING = r'"((?:[^"\\]|\\.)*)"'
+
+
+def fnv1a(name, seed):
+    h = (2166136261 ^ seed) & 0xffffffff
+    for byte in name.encode('utf-8'):
+        h ^= byte
+        h = (h * 16777619) & 0xffffffff
+
+    # the low bits of FNV-1a barely depend on the seed: mix them
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    return h
+
+
+def extract_names(source, table, structures):
+    match = re.search(r'\b' + table + r'\[\]\s*=\s*\{(.*?)\n\};', source,
+                      re.DOTALL)
+    if match is None:
+        sys.exit('Cannot find table {} in validate.c'.format(table))
+
+    body = re.sub(r'/\*.*?\*/', '', match.group(1), flags=re.DOTALL)
+
+    if structures:
+        # the name is the first string of each entry
+        entries = re.findall(r'\{([^{}]*(?:\{[^{}]*\}[^{}]*)*)\}', body)
+        names = [re.search(STRING, entry).group(1) for entry in entries]
+    else:
+        names = re.findall(STRING, body)
+
+    return names
+
+
+def build(names):
+    # the first entry wins when a name appears more than once, like with the
+    # linear lookup this replaces
+    indexes = {}
+    for index, name in enumerate(names):
+        indexes.setdefault(name, index)
+
+    n_slots = len(indexes)
+    n_buckets = max(1, (n_slots + 1) // 2)
+
+    buckets = [[] for _ in range(n_buckets)]
+    for name in indexes:
+        buckets[fnv1a(name, 0) % n_buckets].append(name)
+
+    seeds = [0] * n_buckets
+    slots = [-1] * n_slots
+
+    for bucket in sorted(range(n_buckets), key=lambda b: -len(buckets[b])):
+        if not buckets[bucket]:
+            continue
+
+        seed = 1
+        while True:
+            positions = [fnv1a(name, seed) % n_slots
+                         for name in buckets[bucket]]
+            if (len(set(positions)) == len(positions) and
+                    all(slots[p] == -1 for p in positions)):
+                break
+            seed += 1
+            if seed >= 1 << 24:
+                sys.exit('Cannot build a perfect hash')
+
+        seeds[bucket] = seed
+        for name, position in zip(buckets[bucket], positions):
+            slots[position] = indexes[name]
+
+    return seeds, slots
+
+
+def format_array(values, per_line):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('  ' + ', '.join(str(v) for v in values[i:i + per_line])
+                     + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('Usage: {} validate.c output.h'.format(sys.argv[0]))
+
+    with open(sys.argv[1], encoding='utf-8') as f:
+        source = f.read()
+
+    output = [
+        '/* Generated by gen-perfect-hash.py from validate.c, do not edit */',
+        '',
+    ]
+
+    for table, structures in TABLES:
+        seeds, slots = build(extract_names(source, table, structures))
+
+        output += [
+            'static const guint32 {}_seeds[] = {{'.format(table),
+            format_array(['{}U'.format(s) for s in seeds], 8),
+            '};',
+            '',
+            'static const gint16 {}_slots[] = {{'.format(table),
+            format_array(slots, 12),
+            '};',
+            '',
+            'static const PerfectHash {}_hash = {{'.format(table),
+            '  {0}_seeds, G_N_ELEMENTS ({0}_seeds),'.format(table),
+            '  {0}_slots, G_N_ELEMENTS ({0}_slots)'.format(table),
+            '};',
+            '',
+        ]
+
+    with open(sys.argv[2], 'w', encoding='utf-8') as f:
+        f.write('\n'.join(output))
+
+
+if __name__ == '__main__':
+    main()
@@ -36,7 +36,9 @@
 #include <unistd.h>
 #include <locale.h>
 
+#include "fileutils.h"
 #include "keyfileutils.h"
+#include "mimecache.h"
 #include "validate.h"
 
 static gboolean edit_mode = FALSE;
@@ -48,6 +50,9 @@ static char *vendor_name = NULL;
 static char *target_dir = NULL;
 static GSList *edit_actions = NULL;
 static mode_t permissions = 0644;
+/* Desktop files written or removed in the directory of the MIME cache,
+ * relative to it, when the cache is rebuilt */
+static GPtrArray *changed_files = NULL;
 
 typedef enum
 {
@@ -124,27 +129,34 @@ files_are_the_same (const char *first,
           (first_sb.st_mtime == second_sb.st_mtime));
 }
 
+/* The cache is rebuilt once, after all the files are processed, and without
+ * running update-desktop-database; when possible, only the entries of the
+ * files that changed are updated */
 static gboolean
-rebuild_cache (const char  *dir,
-               GError     **err)
+rebuild_cache (const char *dir)
 {
-  GError *spawn_error;
-  char *argv[4] = { "update-desktop-database", "-q", (char *) dir, NULL };
-  int exit_status;
-  gboolean retval;
+  DfuMimeCacheOptions options = { 0 };
+  GError *error;
 
-  spawn_error = NULL;
+  options.quiet = TRUE;
+  options.jobs = 1;
+  options.read_order = DFU_READ_ORDER_READDIR;
 
-  retval = g_spawn_sync (NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
-                         NULL, NULL, &exit_status, &spawn_error);
+  g_ptr_array_add (changed_files, NULL);
 
-  if (spawn_error != NULL)
+  error = NULL;
+  dfu_mime_cache_update_files (dir, (char **) changed_files->pdata,
+                               &options, NULL, &error);
+
+  if (error != NULL)
     {
-      g_propagate_error (err, spawn_error);
+      g_printerr (_("Could not rebuild the MIME types application database in \"%s\": %s\n"),
+                  dir, error->message);
+      g_error_free (error);
       return FALSE;
     }
 
-  return exit_status == 0 && retval;
+  return TRUE;
 }
 
 static void
@@ -152,18 +164,28 @@ process_one_file (const char *filename,
                   GError    **err)
 {
   char *new_filename;
+  char *data;
+  gsize length;
+  DfuFileContents *contents;
   GKeyFile *kf = NULL;
-  GError *rebuild_error;
   GSList *tmp;
 
+  contents = dfu_file_contents_new (filename, err);
+  if (contents == NULL)
+    return;
+
   kf = g_key_file_new ();
-  if (!g_key_file_load_from_file (kf, filename,
+  if (!g_key_file_load_from_data (kf,
+                                  dfu_file_contents_get_data (contents),
+                                  dfu_file_contents_get_length (contents),
                                   G_KEY_FILE_KEEP_COMMENTS|
                                   G_KEY_FILE_KEEP_TRANSLATIONS,
                                   err)) {
+    dfu_file_contents_free (contents);
     g_key_file_free (kf);
     return;
   }
+  dfu_file_contents_free (contents);
 
   if (!desktop_file_fixup (kf, filename)) {
     g_key_file_free (kf);
@@ -240,27 +262,34 @@ process_one_file (const char *filename,
       g_free (basename);
     }
 
-  if (!dfu_key_file_to_path (kf, new_filename, err)) {
-    g_key_file_free (kf);
+  data = g_key_file_to_data (kf, &length, err);
+  g_key_file_free (kf);
+  if (data == NULL) {
     g_free (new_filename);
     return;
   }
 
-  g_key_file_free (kf);
-
-  /* Load and validate the file we just wrote */
-  if (!desktop_file_validate (new_filename, FALSE, TRUE, TRUE))
+  /* Validate the new contents before writing them, so that an invalid file
+   * is never written */
+  if (!desktop_file_validate_data (new_filename, data, length,
+                                   FALSE, TRUE, TRUE))
     {
       g_set_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
                    _("Failed to validate the created desktop file"));
 
-      if (!files_are_the_same (filename, new_filename))
-        g_unlink (new_filename);
-
+      g_free (data);
       g_free (new_filename);
       return;
     }
 
+  if (!dfu_key_file_data_to_path (data, length, new_filename, err)) {
+    g_free (data);
+    g_free (new_filename);
+    return;
+  }
+
+  g_free (data);
+
   if (!edit_mode)
     {
       if (g_chmod (new_filename, permissions) < 0)
@@ -283,17 +312,19 @@ process_one_file (const char *filename,
           if (g_unlink (filename) < 0)
             g_printerr (_("Error removing original file \"%s\": %s\n"),
                         filename, g_strerror (errno));
+          else if (changed_files != NULL)
+            {
+              char *dirname = g_path_get_dirname (filename);
+
+              if (files_are_the_same (dirname, target_dir))
+                g_ptr_array_add (changed_files, g_path_get_basename (filename));
+              g_free (dirname);
+            }
         }
     }
 
-  if (rebuild_mime_info_cache)
-    {
-      rebuild_error = NULL;
-      rebuild_cache (target_dir, &rebuild_error);
-
-      if (rebuild_error != NULL)
-        g_propagate_error (err, rebuild_error);
-    }
+  if (changed_files != NULL)
+    g_ptr_array_add (changed_files, g_path_get_basename (new_filename));
 
   g_free (new_filename);
 }
@@ -876,6 +907,7 @@ main (int argc, char **argv)
   int args_len;
   mode_t dir_permissions;
   char *basename;
+  char *cache_dir = NULL;
 
 #ifdef HAVE_PLEDGE
   if (pledge ("stdio rpath wpath cpath fattr", NULL) == -1) {
@@ -988,6 +1020,13 @@ main (int argc, char **argv)
         }
     }
 
+  /* in edit mode, the file is edited in place */
+  if (rebuild_mime_info_cache)
+    {
+      cache_dir = edit_mode ? g_path_get_dirname (args[0]) : g_strdup (target_dir);
+      changed_files = g_ptr_array_new_with_free_func (g_free);
+    }
+
   for (i = 0; args && args[i]; i++)
     {
       err = NULL;
@@ -998,10 +1037,26 @@ main (int argc, char **argv)
                       args[i], err->message);
           g_error_free (err);
 
+          /* the files processed before are installed */
+          if (cache_dir && changed_files->len > 0)
+            rebuild_cache (cache_dir);
+
           return 1;
         }
     }
 
+  if (cache_dir)
+    {
+      gboolean rebuilt;
+
+      rebuilt = rebuild_cache (cache_dir);
+      g_free (cache_dir);
+      g_ptr_array_free (changed_files, TRUE);
+
+      if (!rebuilt)
+        return 1;
+    }
+
 #if GLIB_CHECK_VERSION(2,28,0)
   g_slist_free_full (edit_actions, (GDestroyNotify) dfu_edit_action_free);
 #else
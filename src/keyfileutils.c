@@ -245,33 +245,25 @@ dfu_key_file_remove_list (GKeyFile   *keyfile,
   g_string_free (value, TRUE);
 }
 
-//FIXME: kill this when bug #309224 is fixed
+/* Writes @data, serialized from a key file, to @path, which is in UTF-8 */
 gboolean
-dfu_key_file_to_path (GKeyFile     *keyfile,
-                      const char   *path,
-                      GError      **error)
+dfu_key_file_data_to_path (const char   *data,
+                           gsize         length,
+                           const char   *path,
+                           GError      **error)
 {
   char    *filename;
   GError  *write_error;
-  char    *data;
-  gsize    length;
   gboolean res;
 
-  g_return_val_if_fail (keyfile != NULL, FALSE);
+  g_return_val_if_fail (data != NULL, FALSE);
   g_return_val_if_fail (path != NULL, FALSE);
 
   write_error = NULL;
-  data = g_key_file_to_data (keyfile, &length, &write_error);
-  if (write_error) {
-    g_propagate_error (error, write_error);
-    return FALSE;
-  }
-
   filename = g_filename_from_utf8 (path, -1, NULL, NULL, &write_error);
 
   if (write_error) {
     g_propagate_error (error, write_error);
-    g_free (data);
     return FALSE;
   }
 
@@ -280,10 +272,308 @@ dfu_key_file_to_path (GKeyFile     *keyfile,
 
   if (write_error) {
     g_propagate_error (error, write_error);
-    g_free (data);
     return FALSE;
   }
 
-  g_free (data);
   return res;
 }
+
+typedef struct
+{
+  const char *hidden;
+  gsize       hidden_len;
+  const char *mime_type;
+  gsize       mime_type_len;
+} DesktopEntryScan;
+
+static gboolean
+scan_is_group_header (const char  *line,
+                      gsize        len,
+                      const char **name,
+                      gsize       *name_len)
+{
+  const char *end, *p;
+
+  end = line + len;
+  for (p = line + 1; p < end && *p != ']'; p++)
+    {
+      if (*p == '[' || g_ascii_iscntrl (*p))
+        return FALSE;
+    }
+
+  if (p == end || p == line + 1)
+    return FALSE;
+
+  *name = line + 1;
+  *name_len = p - (line + 1);
+
+  /* like GKeyFile, accept whitespace after the ] */
+  for (p++; p < end; p++)
+    {
+      if (*p != ' ' && *p != '\t')
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* This is stricter than GKeyFile: anything unusual is left to it */
+static gboolean
+scan_is_key_name (const char *key,
+                  gsize       len)
+{
+  const char *end, *p;
+
+  end = key + len;
+  for (p = key; p < end && *p != '['; p++)
+    {
+      if ((guchar) *p < 0x20 || (guchar) *p >= 0x80 || *p == ']')
+        return FALSE;
+    }
+
+  if (p == key)
+    return FALSE;
+  if (p == end)
+    return TRUE;
+
+  /* locale */
+  for (p++; p < end && *p != ']'; p++)
+    {
+      if ((guchar) *p <= 0x20 || (guchar) *p >= 0x80 || *p == '[')
+        return FALSE;
+    }
+
+  return (p == end - 1);
+}
+
+static gboolean
+scan_key_is (const char *key,
+             gsize       len,
+             const char *name)
+{
+  return (strlen (name) == len && memcmp (key, name, len) == 0);
+}
+
+/* Looks for the Hidden and MimeType keys of the main group without parsing
+ * anything past it. Returns FALSE on any input that is not straightforward
+ * (escapes, carriage returns, a main group that is not the first group or
+ * that appears twice, lines GKeyFile would reject, ...), in which case the
+ * data has to be handed to GKeyFile. */
+static gboolean
+scan_desktop_entry (const char       *data,
+                    gsize             length,
+                    DesktopEntryScan *scan)
+{
+  const char *p, *end;
+  gboolean in_main_group;
+
+  memset (scan, 0, sizeof (DesktopEntryScan));
+  in_main_group = FALSE;
+
+  p = data;
+  end = data + length;
+  while (p < end)
+    {
+      const char *line, *eol, *equal, *key_end, *value, *value_end;
+
+      line = p;
+      eol = memchr (p, '\n', end - p);
+      if (eol == NULL)
+        eol = end;
+      p = (eol < end) ? eol + 1 : end;
+
+      while (line < eol && g_ascii_isspace (*line))
+        line++;
+
+      if (line == eol || *line == '#')
+        continue;
+
+      if (memchr (line, '\\', eol - line) != NULL ||
+          memchr (line, '\r', eol - line) != NULL ||
+          memchr (line, '\0', eol - line) != NULL)
+        return FALSE;
+
+      if (*line == '[')
+        {
+          const char *name;
+          gsize name_len;
+
+          if (!scan_is_group_header (line, eol - line, &name, &name_len))
+            return FALSE;
+
+          if (!in_main_group)
+            {
+              if (!scan_key_is (name, name_len, GROUP_DESKTOP_ENTRY))
+                return FALSE;
+              in_main_group = TRUE;
+              continue;
+            }
+
+          /* the main group is over, but GKeyFile merges groups sharing the
+           * same name */
+          if (scan_key_is (name, name_len, GROUP_DESKTOP_ENTRY) ||
+              g_strstr_len (p, end - p, "[" GROUP_DESKTOP_ENTRY "]") != NULL)
+            return FALSE;
+
+          return TRUE;
+        }
+
+      if (!in_main_group)
+        return FALSE;
+
+      equal = memchr (line, '=', eol - line);
+      if (equal == NULL)
+        return FALSE;
+
+      key_end = equal;
+      while (key_end > line && g_ascii_isspace (key_end[-1]))
+        key_end--;
+
+      if (!scan_is_key_name (line, key_end - line))
+        return FALSE;
+
+      value = equal + 1;
+      while (value < eol && g_ascii_isspace (*value))
+        value++;
+      value_end = eol;
+
+      if (scan_key_is (line, key_end - line, "Hidden"))
+        {
+          scan->hidden = value;
+          scan->hidden_len = value_end - value;
+        }
+      else if (scan_key_is (line, key_end - line, "MimeType"))
+        {
+          if (value_end > value && g_ascii_isspace (value_end[-1]))
+            return FALSE;
+          if (!g_utf8_validate (value, value_end - value, NULL))
+            return FALSE;
+
+          scan->mime_type = value;
+          scan->mime_type_len = value_end - value;
+        }
+    }
+
+  return in_main_group;
+}
+
+static char **
+scan_split_list (const char *value,
+                 gsize       len)
+{
+  GPtrArray *list;
+  const char *p, *end, *sep;
+
+  list = g_ptr_array_new ();
+
+  p = value;
+  end = value + len;
+  while (p < end)
+    {
+      sep = memchr (p, ';', end - p);
+      if (sep == NULL)
+        sep = end;
+
+      g_ptr_array_add (list, g_strndup (p, sep - p));
+      p = sep + 1;
+    }
+  g_ptr_array_add (list, NULL);
+
+  return (char **) g_ptr_array_free (list, FALSE);
+}
+
+static gboolean
+get_mime_types_from_key_file (const char   *data,
+                              gsize         length,
+                              gboolean     *hidden,
+                              char       ***mime_types,
+                              GError      **error)
+{
+  GError *load_error;
+  GKeyFile *keyfile;
+
+  keyfile = g_key_file_new ();
+
+  load_error = NULL;
+  g_key_file_load_from_data (keyfile, data, length,
+                             G_KEY_FILE_NONE, &load_error);
+
+  if (load_error != NULL)
+    {
+      g_key_file_free (keyfile);
+      g_propagate_error (error, load_error);
+      return FALSE;
+    }
+
+  if (g_key_file_get_boolean (keyfile, GROUP_DESKTOP_ENTRY, "Hidden", NULL))
+    {
+      g_key_file_free (keyfile);
+      *hidden = TRUE;
+      return TRUE;
+    }
+
+  *mime_types = g_key_file_get_string_list (keyfile,
+                                            GROUP_DESKTOP_ENTRY,
+                                            "MimeType", NULL, &load_error);
+  g_key_file_free (keyfile);
+
+  if (load_error != NULL)
+    {
+      g_propagate_error (error, load_error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Gets the value of the Hidden and MimeType keys of the main group of a
+ * desktop file, with the semantics of GKeyFile. If the desktop file is hidden,
+ * @mime_types is not set. Only the main group is looked at, unless the data
+ * is unusual enough to require a full GKeyFile. */
+gboolean
+dfu_desktop_entry_get_mime_types (const char   *data,
+                                  gsize         length,
+                                  gboolean     *hidden,
+                                  char       ***mime_types,
+                                  GError      **error)
+{
+  DesktopEntryScan scan;
+
+  g_return_val_if_fail (data != NULL || length == 0, FALSE);
+  g_return_val_if_fail (hidden != NULL, FALSE);
+  g_return_val_if_fail (mime_types != NULL, FALSE);
+
+  *hidden = FALSE;
+  *mime_types = NULL;
+
+  if (!scan_desktop_entry (data, length, &scan))
+    return get_mime_types_from_key_file (data, length,
+                                         hidden, mime_types, error);
+
+  if (scan.hidden != NULL)
+    {
+      if (scan_key_is (scan.hidden, scan.hidden_len, "true") ||
+          scan_key_is (scan.hidden, scan.hidden_len, "1"))
+        {
+          *hidden = TRUE;
+          return TRUE;
+        }
+      else if (!scan_key_is (scan.hidden, scan.hidden_len, "false") &&
+               !scan_key_is (scan.hidden, scan.hidden_len, "0"))
+        return get_mime_types_from_key_file (data, length,
+                                             hidden, mime_types, error);
+    }
+
+  if (scan.mime_type == NULL)
+    {
+      g_set_error (error, G_KEY_FILE_ERROR,
+                   G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                   "Key file does not have key \"%s\" in group \"%s\"",
+                   "MimeType", GROUP_DESKTOP_ENTRY);
+      return FALSE;
+    }
+
+  *mime_types = scan_split_list (scan.mime_type, scan.mime_type_len);
+
+  return TRUE;
+}
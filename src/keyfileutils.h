@@ -51,9 +51,16 @@ void     dfu_key_file_remove_list  (GKeyFile   *keyfile,
                                     const char *key,
                                     const char *to_remove);
 
-gboolean dfu_key_file_to_path      (GKeyFile     *keyfile,
+gboolean dfu_key_file_data_to_path (const char   *data,
+                                    gsize         length,
                                     const char   *path,
                                     GError      **error);
 
+gboolean dfu_desktop_entry_get_mime_types (const char   *data,
+                                           gsize         length,
+                                           gboolean     *hidden,
+                                           char       ***mime_types,
+                                           GError      **error);
+
 #endif /* __DFU_KEYFILEUTILS_H__ */
 
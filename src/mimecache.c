@@ -0,0 +1,1966 @@
+/* mimecache.c - maintains mimetype<->desktop mapping cache
+ * vim: set ts=2 sw=2 et: */
+
+/*
+ * Copyright (C) 2004-2006  Red Hat, Inc.
+ * Copyright (C) 2006, 2008  Vincent Untz
+ *
+ * Program written by Ray Strode <rstrode@redhat.com>
+ *                    Vincent Untz <vuntz@gnome.org>
+ *
+ * update-desktop-database is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * update-desktop-database is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with update-desktop-database; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite
+ * 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_FIEMAP_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#include "fileutils.h"
+#include "keyfileutils.h"
+#include "mimecache.h"
+#include "mimeutils.h"
+
+#define CACHE_FILENAME "mimeinfo.cache"
+#define CACHE_HEADER "[MIME Cache]\n"
+#define TEMP_CACHE_FILENAME_PREFIX ".mimeinfo.cache.XXXXXX"
+#define MANIFEST_FILENAME ".mimeinfo.manifest"
+#define MANIFEST_HEADER "update-desktop-database manifest 1 " VERSION "\n"
+#define INDEX_FILENAME "mimeinfo.idx"
+
+/* The binary index is a companion of the cache that can be used with mmap()
+ * and binary search, without parsing anything. All integers are 32-bit
+ * big-endian, and all offsets are from the start of the file:
+ *
+ *   header:      "DFUMIDX\0", version, number of MIME types, offset of the
+ *                MIME type table, number of desktop IDs, offset of the
+ *                desktop ID table, size of the file
+ *   MIME types:  (offset of the name, offset of the list) for each MIME type,
+ *                sorted by name with strcmp()
+ *   desktop IDs: offset of the name for each desktop ID, sorted by name; each
+ *                desktop ID is only stored once
+ *   lists:       number of desktop IDs, followed by their indexes in the
+ *                desktop ID table
+ *   strings:     nul-terminated names
+ *
+ * A reader must check the magic, the version and the size of the file. */
+#define INDEX_MAGIC "DFUMIDX"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 32
+
+/* States recorded in the manifest for each desktop file */
+#define MANIFEST_STATE_MIME_TYPES 'm'
+#define MANIFEST_STATE_HIDDEN     'h'
+#define MANIFEST_STATE_NO_MIME    'n'
+/* The cache itself is recorded under an empty path, so that a cache written
+ * without updating the manifest can be detected */
+#define MANIFEST_STATE_CACHE      'c'
+/* Desktop files that could not be parsed are recorded too, so that their
+ * presence is known, but they are always parsed again */
+#define MANIFEST_STATE_ERROR      'e'
+/* Subdirectories are recorded as "a/b/", so that a change in one of them can
+ * be detected without walking it */
+#define MANIFEST_STATE_DIRECTORY  'd'
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#define cache_print(...) if (!quiet) g_printerr (__VA_ARGS__)
+#define cache_verbose_print(...) if (!quiet && verbose) g_printerr (__VA_ARGS__)
+#define cache_job_print(job, ...) if (!quiet) g_string_append_printf ((job)->output, __VA_ARGS__)
+#define cache_job_verbose_print(job, ...) if (!quiet && verbose) g_string_append_printf ((job)->output, __VA_ARGS__)
+
+static FILE *open_temp_cache_file (const char  *dir,
+                                   char       **filename,
+                                   GError     **error);
+static void add_mime_type (const char *mime_type, GPtrArray *desktop_files,
+                           GString *contents);
+static gboolean file_has_contents (const char *filename, GString *contents);
+static void sync_database (const char *dir, GError **error);
+static void cache_desktop_file (const char *desktop_id,
+                                const char *mime_type);
+static void process_desktop_files (int         dir_fd,
+                                   GString    *relative_dir,
+                                   GPtrArray  *files,
+                                   GError    **error);
+static void update_database (const char *desktop_dir, GError **error);
+static gboolean patch_database (const char  *desktop_dir,
+                                char       **relative_paths,
+                                GError     **error);
+
+typedef struct
+{
+  char     state;
+  gint64   mtime;
+  glong    mtime_nsec;
+  gint64   size;
+  guint64  inode;
+  char    *mime_types;
+} ManifestEntry;
+
+/* A desktop file found while walking a directory. Parsing only touches the
+ * job itself, so that it can happen in a worker thread; the results are then
+ * merged in the order the files were found, which keeps the cache and the
+ * messages identical whatever the number of jobs. */
+typedef struct
+{
+  char            *relative_path; /* NULL for a job that only carries output */
+  char            *name;
+  struct stat      buf;
+  gboolean         have_stat;
+  ManifestEntry   *entry;         /* unchanged entry of the previous manifest */
+  DfuFileContents *contents;      /* read in advance in a batch, or NULL */
+  guint64          inode;         /* from readdir(), for --read-order */
+  guint64          physical;      /* of the first extent, for --read-order */
+  gsize            bytes_read;
+
+  char             state;
+  GString         *accepted;      /* accepted MIME types, as a list */
+  GString         *output;        /* messages, printed when merging */
+  GError          *error;
+} DesktopFileJob;
+
+/* MIME types and desktop IDs are interned in an arena, so that each one is
+ * only stored once; the map associates an interned MIME type with an array
+ * of interned desktop IDs */
+static GStringChunk *strings = NULL;
+static GHashTable *mime_types_map = NULL;
+/* The desktop directory being processed; desktop files are opened relative
+ * to it */
+static const char *desktop_dir_path = NULL;
+static int desktop_dir_fd = -1;
+static GHashTable *old_manifest = NULL;
+static GString *new_manifest = NULL;
+
+/* Copied from the DfuMimeCacheOptions of the update in progress */
+static gboolean verbose = FALSE, quiet = FALSE;
+static gboolean incremental = FALSE;
+static gboolean binary_index = FALSE;
+static int jobs = 1;
+static DfuReadOrder read_order = DFU_READ_ORDER_READDIR;
+
+/* Statistics of the update in progress, if they are collected */
+static DfuMimeCacheStats *stats = NULL;
+
+typedef struct
+{
+  gint64 wall_time;
+  gint64 cpu_time;
+} StatsClock;
+
+static void
+stats_clock_start (StatsClock *clock)
+{
+  struct timespec ts;
+
+  if (stats == NULL)
+    return;
+
+  clock->wall_time = g_get_monotonic_time ();
+
+  /* this includes the time spent in worker threads */
+  if (clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts) == 0)
+    clock->cpu_time = (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+  else
+    clock->cpu_time = 0;
+}
+
+/* Adds the time elapsed since @clock was started to @phase, and restarts
+ * @clock for the next phase */
+static void
+stats_clock_add (StatsClock        *clock,
+                 DfuMimeCachePhase  phase)
+{
+  StatsClock now;
+
+  if (stats == NULL)
+    return;
+
+  stats_clock_start (&now);
+  stats->wall_time[phase] += now.wall_time - clock->wall_time;
+  stats->cpu_time[phase] += now.cpu_time - clock->cpu_time;
+  *clock = now;
+}
+
+/* @desktop_id must be interned */
+static void
+cache_desktop_file (const char *desktop_id,
+                    const char *mime_type)
+{
+  GPtrArray *desktop_files;
+
+  desktop_files = g_hash_table_lookup (mime_types_map, mime_type);
+
+  if (desktop_files == NULL)
+    {
+      desktop_files = g_ptr_array_new ();
+      g_hash_table_insert (mime_types_map,
+                           (char *) g_string_chunk_insert_const (strings,
+                                                                 mime_type),
+                           desktop_files);
+    }
+  /* do not add twice a desktop file mentioning the mime type more than once
+   * (no need to search the whole array because we cache all mime types
+   * registered by a desktop file before moving to another desktop file) */
+  else if (desktop_files->len > 0 &&
+           g_ptr_array_index (desktop_files, desktop_files->len - 1) == desktop_id)
+    return;
+
+  g_ptr_array_add (desktop_files, (char *) desktop_id);
+}
+
+static void
+cache_desktop_file_mime_types (const char *desktop_file,
+                               const char *mime_types)
+{
+  const char *desktop_id;
+  char *types, *type, *end;
+
+  desktop_id = g_string_chunk_insert_const (strings, desktop_file);
+
+  types = g_strdup (mime_types);
+  for (type = types; *type != '\0'; type = end)
+    {
+      end = strchr (type, ';');
+      if (end != NULL)
+        *end++ = '\0';
+      else
+        end = type + strlen (type);
+
+      if (type[0] != '\0')
+        cache_desktop_file (desktop_id, type);
+    }
+  g_free (types);
+}
+
+static char *
+get_desktop_id (const char *relative_path)
+{
+  /* the desktop ID of a/b.desktop is a-b.desktop */
+  return g_strdelimit (g_strdup (relative_path), "/", '-');
+}
+
+/* Only needed for messages, so it is not kept in the job */
+static char *
+desktop_file_job_get_path (DesktopFileJob *job)
+{
+  return g_build_filename (desktop_dir_path, job->relative_path, NULL);
+}
+
+/* Sets the manifest state of the desktop file of @job; the MIME types that
+ * were accepted are appended to job->accepted as a list. This may run in a
+ * worker thread. */
+static void
+process_desktop_file (DesktopFileJob *job)
+{
+  DfuFileContents *contents;
+  gboolean hidden;
+  char **mime_types;
+  char *path;
+  int fd, i;
+
+  job->state = MANIFEST_STATE_NO_MIME;
+
+  /* the file may have been read in a batch already */
+  if (job->error != NULL)
+    return;
+
+  contents = job->contents;
+  job->contents = NULL;
+
+  if (contents == NULL)
+    {
+      fd = openat (desktop_dir_fd, job->relative_path, O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+        {
+          int saved_errno = errno;
+
+          g_set_error_literal (&job->error, G_FILE_ERROR,
+                               g_file_error_from_errno (saved_errno),
+                               g_strerror (saved_errno));
+          return;
+        }
+
+      contents = dfu_file_contents_new_from_fd (fd, &job->error);
+      close (fd);
+      if (contents == NULL)
+        return;
+    }
+
+  job->bytes_read = dfu_file_contents_get_length (contents);
+  dfu_desktop_entry_get_mime_types (dfu_file_contents_get_data (contents),
+                                    dfu_file_contents_get_length (contents),
+                                    &hidden, &mime_types, &job->error);
+  dfu_file_contents_free (contents);
+
+  if (job->error != NULL)
+    return;
+
+  /* Hidden=true means that the .desktop file should be completely ignored */
+  if (hidden)
+    {
+      job->state = MANIFEST_STATE_HIDDEN;
+      return;
+    }
+
+  path = NULL;
+  for (i = 0; mime_types[i] != NULL; i++)
+    {
+      char *mime_type;
+      MimeUtilsValidity valid;
+      const char *valid_error;
+
+      mime_type = g_strchomp (mime_types[i]);
+      valid = mu_mime_type_is_valid_cached (mime_types[i], &valid_error);
+      switch (valid)
+      {
+        case MU_VALID:
+          break;
+        case MU_DISCOURAGED:
+          if (path == NULL)
+            path = desktop_file_job_get_path (job);
+          cache_job_print (job,
+                         _("Warning in file \"%s\": usage of MIME type \"%s\" is "
+                           "discouraged (%s)\n"),
+                         path, mime_types[i], valid_error);
+          break;
+        case MU_INVALID:
+          if (path == NULL)
+            path = desktop_file_job_get_path (job);
+          cache_job_print (job,
+                         _("Error in file \"%s\": \"%s\" is an invalid MIME type "
+                           "(%s)\n"),
+                         path, mime_types[i], valid_error);
+          /* not a break: we continue to the next mime type */
+          continue;
+        default:
+          g_assert_not_reached ();
+      }
+
+      g_string_append (job->accepted, mime_type);
+      g_string_append_c (job->accepted, ';');
+    }
+  g_strfreev (mime_types);
+  g_free (path);
+
+  job->state = MANIFEST_STATE_MIME_TYPES;
+}
+
+static void
+manifest_entry_free (ManifestEntry *entry)
+{
+  g_free (entry->mime_types);
+  g_slice_free (ManifestEntry, entry);
+}
+
+static glong
+stat_mtime_nsec (const struct stat *buf)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+  return buf->st_mtim.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+static gboolean
+manifest_entry_matches (const ManifestEntry *entry,
+                        const struct stat   *buf)
+{
+  return (entry->mtime == (gint64) buf->st_mtime &&
+          entry->mtime_nsec == stat_mtime_nsec (buf) &&
+          entry->size == (gint64) buf->st_size &&
+          entry->inode == (guint64) buf->st_ino);
+}
+
+static void
+manifest_append (const char *relative_path,
+                 char        state,
+                 gint64      mtime,
+                 glong       mtime_nsec,
+                 gint64      size,
+                 guint64     inode,
+                 const char *mime_types)
+{
+  char *escaped;
+
+  escaped = g_strescape (relative_path, NULL);
+  g_string_append_printf (new_manifest,
+                          "%c\t%" G_GINT64_FORMAT "\t%ld\t%" G_GINT64_FORMAT
+                          "\t%" G_GUINT64_FORMAT "\t%s\t%s\n",
+                          state, mtime, mtime_nsec, size, inode,
+                          escaped, mime_types ? mime_types : "");
+  g_free (escaped);
+}
+
+static void
+manifest_add_entry (const char        *relative_path,
+                    const struct stat *buf,
+                    char               state,
+                    const char        *mime_types)
+{
+  manifest_append (relative_path, state,
+                   (gint64) buf->st_mtime, stat_mtime_nsec (buf),
+                   (gint64) buf->st_size, (guint64) buf->st_ino,
+                   mime_types);
+}
+
+/* Records the cache just written, which must be done after writing it */
+static void
+manifest_add_cache_entry (const char *dir)
+{
+  struct stat buf;
+  char *cache_file;
+
+  cache_file = g_build_filename (dir, CACHE_FILENAME, NULL);
+  if (stat (cache_file, &buf) == 0)
+    manifest_add_entry ("", &buf, MANIFEST_STATE_CACHE, NULL);
+  g_free (cache_file);
+}
+
+/* Reuses the result of a previous run for an unchanged desktop file */
+static void
+process_manifest_entry (DesktopFileJob      *job,
+                        const ManifestEntry *entry)
+{
+  if (entry->state == MANIFEST_STATE_NO_MIME && !quiet && verbose)
+    {
+      char *path;
+
+      path = desktop_file_job_get_path (job);
+      g_printerr (_("File \"%s\" lacks MimeType key\n"), path);
+      g_free (path);
+    }
+
+  if (entry->state == MANIFEST_STATE_MIME_TYPES)
+    cache_desktop_file_mime_types (job->name, entry->mime_types);
+}
+
+static GHashTable *
+load_manifest (const char *dir)
+{
+  GHashTable *manifest;
+  char *manifest_file;
+  char *contents;
+  char **lines;
+  int i;
+
+  manifest_file = g_build_filename (dir, MANIFEST_FILENAME, NULL);
+  contents = NULL;
+  g_file_get_contents (manifest_file, &contents, NULL, NULL);
+  g_free (manifest_file);
+
+  if (contents == NULL)
+    return NULL;
+
+  /* a manifest written by another version might not have the same view on
+   * which MIME types are valid */
+  if (!g_str_has_prefix (contents, MANIFEST_HEADER))
+    {
+      cache_verbose_print (_("Ignoring outdated manifest in \"%s\"\n"), dir);
+      g_free (contents);
+      return NULL;
+    }
+
+  manifest = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                    (GDestroyNotify) g_free,
+                                    (GDestroyNotify) manifest_entry_free);
+
+  lines = g_strsplit (contents + strlen (MANIFEST_HEADER), "\n", 0);
+  g_free (contents);
+
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      ManifestEntry *entry;
+      char **fields;
+
+      fields = g_strsplit (lines[i], "\t", 7);
+
+      if (g_strv_length (fields) != 7 || strlen (fields[0]) != 1)
+        {
+          g_strfreev (fields);
+          continue;
+        }
+
+      entry = g_slice_new (ManifestEntry);
+      entry->state      = fields[0][0];
+      entry->mtime      = g_ascii_strtoll (fields[1], NULL, 10);
+      entry->mtime_nsec = (glong) g_ascii_strtoll (fields[2], NULL, 10);
+      entry->size       = g_ascii_strtoll (fields[3], NULL, 10);
+      entry->inode      = g_ascii_strtoull (fields[4], NULL, 10);
+      entry->mime_types = g_strdup (fields[6]);
+
+      g_hash_table_replace (manifest, g_strcompress (fields[5]), entry);
+      g_strfreev (fields);
+    }
+  g_strfreev (lines);
+
+  return manifest;
+}
+
+static void
+save_manifest (const char  *dir,
+               GError     **error)
+{
+  char *manifest_file;
+
+  manifest_file = g_build_filename (dir, MANIFEST_FILENAME, NULL);
+  if (!file_has_contents (manifest_file, new_manifest))
+    g_file_set_contents (manifest_file, new_manifest->str, new_manifest->len,
+                         error);
+  g_free (manifest_file);
+}
+
+static DesktopFileJob *
+desktop_file_job_new (void)
+{
+  DesktopFileJob *job;
+
+  job = g_slice_new0 (DesktopFileJob);
+  job->output = g_string_new (NULL);
+
+  return job;
+}
+
+static void
+desktop_file_job_free (DesktopFileJob *job)
+{
+  g_free (job->relative_path);
+  g_free (job->name);
+  dfu_file_contents_free (job->contents);
+  if (job->accepted != NULL)
+    g_string_free (job->accepted, TRUE);
+  g_string_free (job->output, TRUE);
+  if (job->error != NULL)
+    g_error_free (job->error);
+  g_slice_free (DesktopFileJob, job);
+}
+
+/* Walks the directory opened as @dir_fd, which is @relative_dir in the
+ * desktop directory, and appends a job for each desktop file to @files; no
+ * desktop file is parsed here. Entries are only stat()ed when their type is
+ * unknown or a symlink, or when the manifest needs it. @dir_fd is closed. */
+static void
+process_desktop_files (int          dir_fd,
+                       GString     *relative_dir,
+                       GPtrArray   *files,
+                       GError     **error)
+{
+  DIR *dir;
+  struct dirent *dirent;
+  gsize relative_dir_len;
+
+  dir = fdopendir (dir_fd);
+  if (dir == NULL)
+    {
+      int saved_errno = errno;
+
+      close (dir_fd);
+      g_set_error_literal (error, G_FILE_ERROR,
+                           g_file_error_from_errno (saved_errno),
+                           g_strerror (saved_errno));
+      return;
+    }
+
+  relative_dir_len = relative_dir->len;
+
+  while ((dirent = readdir (dir)) != NULL)
+    {
+      const char *filename = dirent->d_name;
+      DesktopFileJob *job;
+      struct stat buf;
+      gboolean have_stat, is_dir;
+
+      if (strcmp (filename, ".") == 0 || strcmp (filename, "..") == 0)
+        continue;
+
+      have_stat = FALSE;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+      if (dirent->d_type != DT_UNKNOWN && dirent->d_type != DT_LNK)
+        is_dir = (dirent->d_type == DT_DIR);
+      else
+#endif
+        {
+          /* follow symlinks, like stat() */
+          have_stat = (fstatat (dirfd (dir), filename, &buf, 0) == 0);
+          is_dir = have_stat && S_ISDIR (buf.st_mode);
+        }
+
+      if (is_dir)
+        {
+          GError *process_error;
+          int sub_dir_fd;
+
+          g_string_append (relative_dir, filename);
+
+          process_error = NULL;
+          sub_dir_fd = openat (dirfd (dir), filename,
+                               O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+          if (sub_dir_fd < 0)
+            {
+              int saved_errno = errno;
+
+              g_set_error_literal (&process_error, G_FILE_ERROR,
+                                   g_file_error_from_errno (saved_errno),
+                                   g_strerror (saved_errno));
+            }
+          else
+            {
+              struct stat dir_buf;
+
+              g_string_append_c (relative_dir, '/');
+
+              /* recorded before the walk: a change during the walk is seen
+               * as a change since the walk */
+              if (new_manifest != NULL && fstat (sub_dir_fd, &dir_buf) == 0)
+                manifest_add_entry (relative_dir->str, &dir_buf,
+                                    MANIFEST_STATE_DIRECTORY, NULL);
+
+              process_desktop_files (sub_dir_fd, relative_dir, files,
+                                     &process_error);
+              g_string_truncate (relative_dir,
+                                 relative_dir_len + strlen (filename));
+            }
+
+          if (process_error != NULL)
+            {
+              char *full_path;
+
+              full_path = g_build_filename (desktop_dir_path,
+                                            relative_dir->str, NULL);
+              job = desktop_file_job_new ();
+              cache_job_verbose_print (job,
+                                     _("Could not process directory \"%s\": %s\n"),
+                                     full_path, process_error->message);
+              g_ptr_array_add (files, job);
+
+              g_free (full_path);
+              g_error_free (process_error);
+            }
+
+          g_string_truncate (relative_dir, relative_dir_len);
+          continue;
+        }
+
+      if (stats != NULL)
+        stats->files_scanned++;
+
+      if (!g_str_has_suffix (filename, ".desktop"))
+        {
+          if (stats != NULL)
+            stats->skipped_not_desktop++;
+          continue;
+        }
+
+      if (!have_stat && new_manifest != NULL)
+        have_stat = (fstatat (dirfd (dir), filename, &buf, 0) == 0);
+
+      job = desktop_file_job_new ();
+      job->relative_path = g_strconcat (relative_dir->str, filename, NULL);
+      job->name = get_desktop_id (job->relative_path);
+      job->inode = dirent->d_ino;
+      job->have_stat = have_stat;
+      if (have_stat)
+        job->buf = buf;
+
+      if (old_manifest != NULL && have_stat)
+        {
+          ManifestEntry *entry;
+
+          entry = g_hash_table_lookup (old_manifest, job->relative_path);
+          if (entry != NULL && entry->state != MANIFEST_STATE_ERROR &&
+              manifest_entry_matches (entry, &buf))
+            job->entry = entry;
+        }
+
+      if (job->entry == NULL)
+        job->accepted = g_string_new (NULL);
+
+      g_ptr_array_add (files, job);
+    }
+
+  closedir (dir);
+}
+
+/* Number of jobs parsed by the thread pool, so that files are not read in
+ * advance much faster than they are parsed */
+typedef struct
+{
+  GMutex mutex;
+  GCond  cond;
+  guint  n_parsed;
+} ParseProgress;
+
+/* The contents read in advance are freed once parsed */
+static void
+parse_desktop_file_job (gpointer data,
+                        gpointer user_data)
+{
+  DesktopFileJob *job = data;
+  ParseProgress *progress = user_data;
+
+  if (job->relative_path != NULL && job->entry == NULL)
+    process_desktop_file (job);
+
+  /* already done by process_desktop_file(), unless it failed early */
+  dfu_file_contents_free (job->contents);
+  job->contents = NULL;
+
+  if (progress != NULL)
+    {
+      g_mutex_lock (&progress->mutex);
+      progress->n_parsed++;
+      g_cond_signal (&progress->cond);
+      g_mutex_unlock (&progress->mutex);
+    }
+}
+
+/* Reads the desktop files of jobs[0..n_jobs-1] in one batch when the system
+ * supports it; otherwise, each file is read when it is parsed */
+static void
+read_desktop_file_jobs (DesktopFileJob **jobs_batch,
+                        guint            n_jobs)
+{
+  const char *paths[DFU_BATCH_SIZE];
+  DfuFileContents *contents[DFU_BATCH_SIZE];
+  GError *errors[DFU_BATCH_SIZE];
+  DesktopFileJob *to_read[DFU_BATCH_SIZE];
+  guint i, n_paths;
+
+  n_paths = 0;
+  for (i = 0; i < n_jobs; i++)
+    {
+      if (jobs_batch[i]->relative_path == NULL || jobs_batch[i]->entry != NULL)
+        continue;
+
+      to_read[n_paths] = jobs_batch[i];
+      paths[n_paths] = jobs_batch[i]->relative_path;
+      errors[n_paths] = NULL;
+      n_paths++;
+    }
+
+  if (n_paths < 2 ||
+      !dfu_file_contents_read_batch (desktop_dir_fd, paths, n_paths,
+                                     contents, errors))
+    return;
+
+  for (i = 0; i < n_paths; i++)
+    {
+      to_read[i]->contents = contents[i];
+      to_read[i]->error = errors[i];
+    }
+}
+
+static void
+parse_desktop_file_jobs (GPtrArray *files)
+{
+  GThreadPool *pool;
+  ParseProgress progress;
+  guint i, j;
+
+  pool = NULL;
+  if (jobs > 1 && files->len > 1)
+    {
+      g_mutex_init (&progress.mutex);
+      g_cond_init (&progress.cond);
+      progress.n_parsed = 0;
+      pool = g_thread_pool_new (parse_desktop_file_job, &progress,
+                                MIN ((guint) jobs, files->len), FALSE, NULL);
+    }
+
+  /* the next batch is read while the previous one is being parsed, but not
+   * before the one before it is parsed: at most two batches are kept in
+   * memory */
+  for (i = 0; i < files->len; i += DFU_BATCH_SIZE)
+    {
+      guint n_jobs = MIN (DFU_BATCH_SIZE, files->len - i);
+
+      if (pool != NULL && i >= DFU_BATCH_SIZE)
+        {
+          g_mutex_lock (&progress.mutex);
+          while (progress.n_parsed < i - DFU_BATCH_SIZE)
+            g_cond_wait (&progress.cond, &progress.mutex);
+          g_mutex_unlock (&progress.mutex);
+        }
+
+      read_desktop_file_jobs ((DesktopFileJob **) files->pdata + i, n_jobs);
+
+      for (j = i; j < i + n_jobs; j++)
+        {
+          if (pool != NULL)
+            g_thread_pool_push (pool, g_ptr_array_index (files, j), NULL);
+          else
+            parse_desktop_file_job (g_ptr_array_index (files, j), NULL);
+        }
+    }
+
+  /* wait for all the desktop files to be parsed */
+  if (pool != NULL)
+    {
+      g_thread_pool_free (pool, FALSE, TRUE);
+      g_cond_clear (&progress.cond);
+      g_mutex_clear (&progress.mutex);
+    }
+}
+
+/* Tells the kernel to start reading the file now, so that the reads of all
+ * the files can be scheduled in the order of the disk */
+static void
+advise_desktop_file_fd (int fd)
+{
+#ifdef HAVE_POSIX_FADVISE
+  posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/* Sets the physical offset of the file, or G_MAXUINT64 when it has no known
+ * location on the disk, and starts reading it: the file is only opened once
+ * for both */
+static void
+locate_desktop_file (DesktopFileJob *job)
+{
+  int fd;
+#ifdef HAVE_LINUX_FIEMAP_H
+  guint64 request[(sizeof (struct fiemap) +
+                   sizeof (struct fiemap_extent)) / sizeof (guint64) + 1];
+  struct fiemap *fiemap = (struct fiemap *) request;
+#endif
+
+  job->physical = G_MAXUINT64;
+
+  fd = openat (desktop_dir_fd, job->relative_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+#ifdef HAVE_LINUX_FIEMAP_H
+  memset (request, 0, sizeof (request));
+  fiemap->fm_length = FIEMAP_MAX_OFFSET;
+  fiemap->fm_extent_count = 1;
+
+  if (ioctl (fd, FS_IOC_FIEMAP, fiemap) == 0 &&
+      fiemap->fm_mapped_extents > 0 &&
+      !(fiemap->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN |
+                                          FIEMAP_EXTENT_DATA_INLINE |
+                                          FIEMAP_EXTENT_NOT_ALIGNED)))
+    job->physical = fiemap->fm_extents[0].fe_physical;
+#endif
+
+  advise_desktop_file_fd (fd);
+  close (fd);
+}
+
+static int
+compare_read_order (DesktopFileJob **a,
+                    DesktopFileJob **b)
+{
+  /* files without a known location come last, in inode order */
+  if ((*a)->physical != (*b)->physical)
+    return (*a)->physical < (*b)->physical ? -1 : 1;
+  if ((*a)->inode != (*b)->inode)
+    return (*a)->inode < (*b)->inode ? -1 : 1;
+  return 0;
+}
+
+static void
+advise_desktop_file (DesktopFileJob *job)
+{
+#ifdef HAVE_POSIX_FADVISE
+  int fd;
+
+  fd = openat (desktop_dir_fd, job->relative_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  advise_desktop_file_fd (fd);
+  close (fd);
+#endif
+}
+
+/* Returns the jobs in the order their files should be read; this does not
+ * change the order in which they are merged */
+static GPtrArray *
+order_desktop_file_jobs (GPtrArray *files)
+{
+  GPtrArray *ordered;
+  guint i;
+
+  ordered = g_ptr_array_sized_new (files->len);
+  for (i = 0; i < files->len; i++)
+    {
+      DesktopFileJob *job = g_ptr_array_index (files, i);
+
+      if (job->relative_path == NULL || job->entry != NULL)
+        continue;
+
+      job->physical = G_MAXUINT64;
+      if (read_order == DFU_READ_ORDER_EXTENT)
+        locate_desktop_file (job);
+
+      g_ptr_array_add (ordered, job);
+    }
+
+  g_ptr_array_sort (ordered, (GCompareFunc) compare_read_order);
+
+  /* in extent order, the files were already advised when located: the
+   * block layer schedules those reads in the order of the disk anyway */
+  if (read_order != DFU_READ_ORDER_EXTENT)
+    {
+      for (i = 0; i < ordered->len; i++)
+        advise_desktop_file (g_ptr_array_index (ordered, i));
+    }
+
+  return ordered;
+}
+
+static void
+stats_count_job (DesktopFileJob *job)
+{
+  char state;
+
+  if (job->entry != NULL)
+    {
+      stats->unchanged++;
+      state = job->entry->state;
+    }
+  else if (job->error != NULL &&
+           !g_error_matches (job->error,
+                             G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND))
+    {
+      stats->skipped_parse_error++;
+      state = 0;
+    }
+  else
+    state = job->state;
+
+  stats->bytes_read += job->bytes_read;
+
+  if (state == MANIFEST_STATE_HIDDEN)
+    stats->skipped_hidden++;
+  else if (state == MANIFEST_STATE_NO_MIME)
+    stats->skipped_no_mime_type++;
+}
+
+static void
+merge_desktop_file_job (DesktopFileJob *job)
+{
+  if (job->output->len > 0)
+    g_printerr ("%s", job->output->str);
+
+  if (job->relative_path == NULL)
+    return;
+
+  if (stats != NULL)
+    stats_count_job (job);
+
+  if (job->entry != NULL)
+    {
+      process_manifest_entry (job, job->entry);
+      manifest_add_entry (job->relative_path, &job->buf,
+                          job->entry->state, job->entry->mime_types);
+      return;
+    }
+
+  if (job->error != NULL)
+    {
+      char *path;
+
+      path = desktop_file_job_get_path (job);
+
+      /* files that could not be parsed are parsed again on the next
+       * run, so that the error is reported again */
+      if (!g_error_matches (job->error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_KEY_NOT_FOUND))
+        {
+          cache_print (_("Could not parse file \"%s\": %s\n"), path,
+                     job->error->message);
+
+          if (new_manifest != NULL && job->have_stat)
+            manifest_add_entry (job->relative_path, &job->buf,
+                                MANIFEST_STATE_ERROR, NULL);
+        }
+      else
+        {
+          cache_verbose_print (_("File \"%s\" lacks MimeType key\n"), path);
+
+          if (new_manifest != NULL && job->have_stat)
+            manifest_add_entry (job->relative_path, &job->buf,
+                                job->state, NULL);
+        }
+
+      g_free (path);
+      return;
+    }
+
+  cache_desktop_file_mime_types (job->name, job->accepted->str);
+
+  if (new_manifest != NULL && job->have_stat)
+    manifest_add_entry (job->relative_path, &job->buf,
+                        job->state, job->accepted->str);
+}
+
+static FILE *
+open_temp_cache_file (const char *dir, char **filename, GError **error)
+{
+  int fd;
+  char *file;
+  FILE *fp;
+  mode_t mask;
+
+  file = g_build_filename (dir, TEMP_CACHE_FILENAME_PREFIX, NULL);
+  fd = g_mkstemp (file);
+
+  if (fd < 0)
+    {
+      g_set_error (error, G_FILE_ERROR,
+                   g_file_error_from_errno (errno),
+                   "%s", g_strerror (errno));
+      g_free (file);
+      return NULL;
+    }
+
+  mask = umask(0);
+  (void) umask (mask);
+
+  fchmod (fd, 0666 & ~mask);
+
+  fp = fdopen (fd, "w+");
+  if (fp == NULL)
+    {
+      g_set_error (error, G_FILE_ERROR,
+                   g_file_error_from_errno (errno),
+                   "%s", g_strerror (errno));
+      g_free (file);
+      close (fd);
+      return NULL;
+    }
+
+  if (filename)
+    *filename = file;
+  else
+    g_free (file);
+
+  return fp;
+}
+
+static void
+add_mime_type (const char *mime_type, GPtrArray *desktop_files,
+               GString *contents)
+{
+  guint i;
+
+  g_string_append (contents, mime_type);
+  g_string_append_c (contents, '=');
+  for (i = 0; i < desktop_files->len; i++)
+    {
+      g_string_append (contents, g_ptr_array_index (desktop_files, i));
+      g_string_append_c (contents, ';');
+    }
+  g_string_append_c (contents, '\n');
+}
+
+/* Rewriting a file that did not change would needlessly wake up all the file
+ * monitors watching the directory, so we first compare with what is there */
+static gboolean
+file_has_contents (const char *filename,
+                   GString    *contents)
+{
+  struct stat buf;
+  char *current;
+  gsize length;
+  gboolean same;
+
+  if (stat (filename, &buf) < 0 || !S_ISREG (buf.st_mode) ||
+      buf.st_size != (off_t) contents->len)
+    return FALSE;
+
+  if (!g_file_get_contents (filename, &current, &length, NULL))
+    return FALSE;
+
+  same = (length == contents->len &&
+          memcmp (current, contents->str, length) == 0);
+  g_free (current);
+
+  return same;
+}
+
+static void
+append_uint32 (GString *string,
+               guint32  value)
+{
+  value = GUINT32_TO_BE (value);
+  g_string_append_len (string, (const char *) &value, sizeof (value));
+}
+
+static int
+sort_strings (const char **a,
+              const char **b)
+{
+  return strcmp (*a, *b);
+}
+
+/* Builds the binary index described with INDEX_MAGIC; keys are the sorted
+ * MIME types */
+static GString *
+build_binary_index (GPtrArray *keys)
+{
+  GHashTable *ids_table;
+  GPtrArray *ids;
+  GString *index, *lists, *names;
+  guint n_list_words, i, j;
+  guint32 mime_types_offset, ids_offset, lists_offset, names_offset, size;
+
+  /* desktop IDs are interned, so they can be compared as pointers */
+  ids_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+  ids = g_ptr_array_new ();
+  n_list_words = 0;
+
+  for (i = 0; i < keys->len; i++)
+    {
+      GPtrArray *desktop_files;
+
+      desktop_files = g_hash_table_lookup (mime_types_map,
+                                           g_ptr_array_index (keys, i));
+      for (j = 0; j < desktop_files->len; j++)
+        {
+          gpointer id = g_ptr_array_index (desktop_files, j);
+
+          if (!g_hash_table_contains (ids_table, id))
+            {
+              g_hash_table_add (ids_table, id);
+              g_ptr_array_add (ids, id);
+            }
+        }
+      n_list_words += 1 + desktop_files->len;
+    }
+
+  g_ptr_array_sort (ids, (GCompareFunc) sort_strings);
+  for (i = 0; i < ids->len; i++)
+    g_hash_table_insert (ids_table, g_ptr_array_index (ids, i),
+                         GUINT_TO_POINTER (i));
+
+  mime_types_offset = INDEX_HEADER_SIZE;
+  ids_offset = mime_types_offset + keys->len * 2 * 4;
+  lists_offset = ids_offset + ids->len * 4;
+  names_offset = lists_offset + n_list_words * 4;
+
+  index = g_string_sized_new (names_offset);
+  lists = g_string_sized_new (n_list_words * 4);
+  names = g_string_new (NULL);
+
+  /* the size of the file is set once known */
+  g_string_append_len (index, INDEX_MAGIC, sizeof (INDEX_MAGIC));
+  append_uint32 (index, INDEX_VERSION);
+  append_uint32 (index, keys->len);
+  append_uint32 (index, mime_types_offset);
+  append_uint32 (index, ids->len);
+  append_uint32 (index, ids_offset);
+  append_uint32 (index, 0);
+
+  g_assert (index->len == INDEX_HEADER_SIZE);
+
+  for (i = 0; i < keys->len; i++)
+    {
+      const char *mime_type = g_ptr_array_index (keys, i);
+      GPtrArray *desktop_files;
+
+      desktop_files = g_hash_table_lookup (mime_types_map, mime_type);
+
+      append_uint32 (index, names_offset + names->len);
+      g_string_append_len (names, mime_type, strlen (mime_type) + 1);
+
+      append_uint32 (index, lists_offset + lists->len);
+      append_uint32 (lists, desktop_files->len);
+      for (j = 0; j < desktop_files->len; j++)
+        {
+          gpointer id = g_ptr_array_index (desktop_files, j);
+
+          append_uint32 (lists,
+                         GPOINTER_TO_UINT (g_hash_table_lookup (ids_table, id)));
+        }
+    }
+
+  for (i = 0; i < ids->len; i++)
+    {
+      const char *id = g_ptr_array_index (ids, i);
+
+      append_uint32 (index, names_offset + names->len);
+      g_string_append_len (names, id, strlen (id) + 1);
+    }
+
+  g_string_append_len (index, lists->str, lists->len);
+  g_string_append_len (index, names->str, names->len);
+
+  g_assert (index->len == names_offset + names->len);
+
+  size = GUINT32_TO_BE (index->len);
+  memcpy (index->str + INDEX_HEADER_SIZE - sizeof (size), &size, sizeof (size));
+
+  g_string_free (names, TRUE);
+  g_string_free (lists, TRUE);
+  g_ptr_array_free (ids, TRUE);
+  g_hash_table_destroy (ids_table);
+
+  return index;
+}
+
+/* Atomically replaces the file, unless it already has the same contents */
+static void
+write_cache_file (const char  *dir,
+                  const char  *name,
+                  GString     *contents,
+                  GError     **error)
+{
+  GError *sync_error;
+  char *temp_cache_file, *cache_file;
+  FILE *tmp_file;
+
+  cache_file = g_build_filename (dir, name, NULL);
+  if (file_has_contents (cache_file, contents))
+    {
+      cache_verbose_print (_("Cache file \"%s\" is already up to date\n"),
+                         cache_file);
+      g_free (cache_file);
+      return;
+    }
+
+  temp_cache_file = NULL;
+  sync_error = NULL;
+  tmp_file = open_temp_cache_file (dir, &temp_cache_file, &sync_error);
+
+  if (sync_error != NULL)
+    {
+      g_propagate_error (error, sync_error);
+      g_free (cache_file);
+      return;
+    }
+
+  fwrite (contents->str, 1, contents->len, tmp_file);
+
+  if (fclose (tmp_file) == EOF)
+    {
+      g_set_error (error, G_FILE_ERROR,
+                   g_file_error_from_errno (errno),
+                   _("Cache file \"%s\" could not be written: %s"),
+                   cache_file, g_strerror (errno));
+
+      unlink (temp_cache_file);
+    }
+  else if (rename (temp_cache_file, cache_file) < 0)
+    {
+      g_set_error (error, G_FILE_ERROR,
+                   g_file_error_from_errno (errno),
+                   _("Cache file \"%s\" could not be written: %s"),
+                   cache_file, g_strerror (errno));
+
+      unlink (temp_cache_file);
+    }
+  g_free (temp_cache_file);
+  g_free (cache_file);
+}
+
+static gboolean
+has_binary_index (const char *dir)
+{
+  char *index_file;
+  gboolean exists;
+
+  index_file = g_build_filename (dir, INDEX_FILENAME, NULL);
+  exists = g_file_test (index_file, G_FILE_TEST_IS_REGULAR);
+  g_free (index_file);
+
+  return exists;
+}
+
+static void
+sync_database (const char *dir, GError **error)
+{
+  GError *sync_error;
+  GHashTableIter iter;
+  gpointer key, value;
+  GString *contents;
+  GPtrArray *keys;
+  StatsClock clock;
+  guint i;
+
+  stats_clock_start (&clock);
+
+  /* sort the MIME types and the desktop files of each MIME type once, for
+   * both the cache and the index */
+  keys = g_ptr_array_sized_new (g_hash_table_size (mime_types_map));
+  g_hash_table_iter_init (&iter, mime_types_map);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      g_ptr_array_add (keys, key);
+      g_ptr_array_sort (value, (GCompareFunc) sort_strings);
+      if (stats != NULL)
+        stats->associations += ((GPtrArray *) value)->len;
+    }
+  g_ptr_array_sort (keys, (GCompareFunc) sort_strings);
+
+  if (stats != NULL)
+    stats->mime_types += keys->len;
+
+  stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_SORT);
+
+  contents = g_string_new (CACHE_HEADER);
+
+  for (i = 0; i < keys->len; i++)
+    add_mime_type (g_ptr_array_index (keys, i),
+                   g_hash_table_lookup (mime_types_map,
+                                        g_ptr_array_index (keys, i)),
+                   contents);
+
+  sync_error = NULL;
+  write_cache_file (dir, CACHE_FILENAME, contents, &sync_error);
+  g_string_free (contents, TRUE);
+
+  /* an index written by a previous run is kept up to date, as some other
+   * tool may rely on it */
+  if (sync_error == NULL && (binary_index || has_binary_index (dir)))
+    {
+      contents = build_binary_index (keys);
+      write_cache_file (dir, INDEX_FILENAME, contents, &sync_error);
+      g_string_free (contents, TRUE);
+    }
+
+  if (sync_error != NULL)
+    g_propagate_error (error, sync_error);
+
+  g_ptr_array_free (keys, TRUE);
+
+  stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_WRITE);
+}
+
+/* Opens @desktop_dir and sets up the state shared by a full update and a
+ * patch of the cache */
+static gboolean
+open_database (const char  *desktop_dir,
+               GError     **error)
+{
+  desktop_dir_fd = open (desktop_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (desktop_dir_fd < 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR,
+                   g_file_error_from_errno (saved_errno),
+                   _("Error opening directory \"%s\": %s"),
+                   desktop_dir, g_strerror (saved_errno));
+      return FALSE;
+    }
+  desktop_dir_path = desktop_dir;
+
+  strings = g_string_chunk_new (4096);
+  mime_types_map = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          NULL,
+                                          (GDestroyNotify) g_ptr_array_unref);
+
+  return TRUE;
+}
+
+static void
+close_database (void)
+{
+  g_hash_table_destroy (mime_types_map);
+  mime_types_map = NULL;
+  g_string_chunk_free (strings);
+  strings = NULL;
+
+  close (desktop_dir_fd);
+  desktop_dir_fd = -1;
+  desktop_dir_path = NULL;
+
+  if (old_manifest != NULL)
+    {
+      g_hash_table_destroy (old_manifest);
+      old_manifest = NULL;
+    }
+  if (new_manifest != NULL)
+    {
+      g_string_free (new_manifest, TRUE);
+      new_manifest = NULL;
+    }
+}
+
+/* Writes the cache from mime_types_map, then the manifest if any */
+static void
+write_database (const char  *desktop_dir,
+                GError     **error)
+{
+  GError *write_error;
+  StatsClock clock;
+
+  write_error = NULL;
+  sync_database (desktop_dir, &write_error);
+  if (write_error != NULL)
+    {
+      g_propagate_error (error, write_error);
+      return;
+    }
+
+  if (new_manifest == NULL)
+    return;
+
+  stats_clock_start (&clock);
+  manifest_add_cache_entry (desktop_dir);
+  save_manifest (desktop_dir, &write_error);
+  if (write_error != NULL)
+    {
+      cache_verbose_print (_("Could not write manifest in \"%s\": %s\n"),
+                         desktop_dir, write_error->message);
+      g_error_free (write_error);
+    }
+  stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_WRITE);
+}
+
+static void
+update_database (const char  *desktop_dir,
+                 GError     **error)
+{
+  GError *update_error;
+  GPtrArray *files;
+  GString *relative_dir;
+  StatsClock clock;
+  guint i;
+
+  if (!open_database (desktop_dir, error))
+    return;
+
+  stats_clock_start (&clock);
+
+  if (incremental)
+    {
+      old_manifest = load_manifest (desktop_dir);
+      new_manifest = g_string_new (MANIFEST_HEADER);
+    }
+
+  files = g_ptr_array_new_with_free_func ((GDestroyNotify) desktop_file_job_free);
+
+  /* the walk closes the descriptor it is given, but desktop files are
+   * opened relative to desktop_dir_fd until they are all parsed */
+  update_error = NULL;
+  relative_dir = g_string_new (NULL);
+  process_desktop_files (dup (desktop_dir_fd), relative_dir, files,
+                         &update_error);
+  g_string_free (relative_dir, TRUE);
+
+  stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_TRAVERSE);
+
+  if (update_error != NULL)
+    g_propagate_error (error, update_error);
+  else
+    {
+      if (read_order != DFU_READ_ORDER_READDIR)
+        {
+          GPtrArray *ordered;
+
+          ordered = order_desktop_file_jobs (files);
+          parse_desktop_file_jobs (ordered);
+          g_ptr_array_free (ordered, TRUE);
+        }
+      else
+        parse_desktop_file_jobs (files);
+
+      for (i = 0; i < files->len; i++)
+        merge_desktop_file_job (g_ptr_array_index (files, i));
+
+      stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_PARSE);
+
+      write_database (desktop_dir, error);
+    }
+  g_ptr_array_free (files, TRUE);
+
+  close_database ();
+}
+
+/* Fills mime_types_map from the cache written by a previous update */
+static gboolean
+load_cache (const char *dir)
+{
+  char *cache_file;
+  char *contents;
+  char *line, *end;
+  gboolean loaded;
+
+  cache_file = g_build_filename (dir, CACHE_FILENAME, NULL);
+  loaded = g_file_get_contents (cache_file, &contents, NULL, NULL);
+  g_free (cache_file);
+
+  if (!loaded)
+    return FALSE;
+
+  if (!g_str_has_prefix (contents, CACHE_HEADER))
+    {
+      g_free (contents);
+      return FALSE;
+    }
+
+  for (line = contents + strlen (CACHE_HEADER); *line != '\0'; line = end)
+    {
+      char *desktop_id, *next;
+
+      end = strchr (line, '\n');
+      if (end != NULL)
+        *end++ = '\0';
+      else
+        end = line + strlen (line);
+
+      desktop_id = strchr (line, '=');
+      if (desktop_id == NULL)
+        {
+          loaded = FALSE;
+          break;
+        }
+      *desktop_id++ = '\0';
+
+      for (; *desktop_id != '\0'; desktop_id = next)
+        {
+          next = strchr (desktop_id, ';');
+          if (next != NULL)
+            *next++ = '\0';
+          else
+            next = desktop_id + strlen (desktop_id);
+
+          if (desktop_id[0] != '\0')
+            cache_desktop_file (g_string_chunk_insert_const (strings,
+                                                             desktop_id),
+                                line);
+        }
+    }
+  g_free (contents);
+
+  return loaded;
+}
+
+/* Removes all the associations of @desktop_id, which must be interned */
+static void
+uncache_desktop_file (const char *desktop_id)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, mime_types_map);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GPtrArray *desktop_files = value;
+
+      while (g_ptr_array_remove (desktop_files, (char *) desktop_id))
+        ;
+
+      if (desktop_files->len == 0)
+        g_hash_table_iter_remove (&iter);
+    }
+}
+
+/* Whether the cache and the manifest of the directory being opened were
+ * written together, so that the manifest tells which desktop file each
+ * association of the cache comes from */
+static gboolean
+manifest_matches_cache (const char *dir)
+{
+  ManifestEntry *entry;
+  struct stat buf;
+  char *cache_file;
+  gboolean matches;
+
+  entry = g_hash_table_lookup (old_manifest, "");
+  if (entry == NULL || entry->state != MANIFEST_STATE_CACHE)
+    return FALSE;
+
+  cache_file = g_build_filename (dir, CACHE_FILENAME, NULL);
+  matches = (stat (cache_file, &buf) == 0 &&
+             manifest_entry_matches (entry, &buf));
+  g_free (cache_file);
+
+  return matches;
+}
+
+/* Whether the desktop files of the directory being opened are still those
+ * of the manifest, except for @patched_paths. The subdirectories must not
+ * have changed since they were walked, except for @patched_dirs, which have
+ * the patched files and so changed with them; the top directory, where the cache
+ * itself is written, must still have the same desktop files (same names and
+ * inodes) and subdirectories, which only takes reading its entries. A file
+ * changed in place, without being replaced, is not seen. */
+static gboolean
+manifest_matches_directory (GHashTable *patched_paths,
+                            GHashTable *patched_dirs)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  struct dirent *dirent;
+  DIR *dir;
+  guint n_top_entries, n_seen;
+  gboolean matches;
+  int fd;
+
+  matches = TRUE;
+  n_top_entries = 0;
+
+  g_hash_table_iter_init (&iter, old_manifest);
+  while (matches && g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const char *path = key;
+      const char *slash;
+      ManifestEntry *entry = value;
+      struct stat buf;
+
+      if (path[0] == '\0' || g_hash_table_contains (patched_paths, path))
+        continue;
+
+      slash = strchr (path, '/');
+
+      if (entry->state == MANIFEST_STATE_DIRECTORY)
+        {
+          if (!g_hash_table_contains (patched_dirs, path))
+            matches = (fstatat (desktop_dir_fd, path, &buf, 0) == 0 &&
+                       manifest_entry_matches (entry, &buf));
+          if (slash != NULL && slash[1] == '\0')
+            n_top_entries++;
+        }
+      else if (slash == NULL)
+        n_top_entries++;
+    }
+
+  if (!matches)
+    return FALSE;
+
+  fd = openat (desktop_dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return FALSE;
+
+  dir = fdopendir (fd);
+  if (dir == NULL)
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  n_seen = 0;
+  while (matches && (dirent = readdir (dir)) != NULL)
+    {
+      const char *name = dirent->d_name;
+      ManifestEntry *entry;
+      gboolean is_dir;
+      guint64 inode;
+      char *path;
+
+      if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+        continue;
+
+      inode = dirent->d_ino;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+      if (dirent->d_type != DT_UNKNOWN && dirent->d_type != DT_LNK)
+        is_dir = (dirent->d_type == DT_DIR);
+      else
+#endif
+        {
+          struct stat buf;
+
+          /* follow symlinks, like the walk */
+          if (fstatat (dirfd (dir), name, &buf, 0) < 0)
+            continue;
+          is_dir = S_ISDIR (buf.st_mode);
+          inode = buf.st_ino;
+        }
+
+      if (is_dir)
+        path = g_strconcat (name, "/", NULL);
+      else if (g_str_has_suffix (name, ".desktop"))
+        path = g_strdup (name);
+      else
+        continue;
+
+      if (!g_hash_table_contains (patched_paths, path))
+        {
+          entry = g_hash_table_lookup (old_manifest, path);
+
+          /* the inode of a subdirectory was checked with its stat */
+          if (entry == NULL ||
+              (entry->state == MANIFEST_STATE_DIRECTORY) != is_dir ||
+              (!is_dir && entry->inode != inode))
+            matches = FALSE;
+          else
+            n_seen++;
+        }
+
+      g_free (path);
+    }
+  closedir (dir);
+
+  /* a desktop file or subdirectory was removed */
+  return matches && n_seen == n_top_entries;
+}
+
+/* Updates the cache for the desktop files at @relative_paths only, reusing
+ * the cache and the manifest of a previous incremental update for all the
+ * others; desktop files that do not exist anymore are removed from the
+ * cache. Returns FALSE, without touching anything, when the cache cannot be
+ * patched and must be rebuilt. */
+static gboolean
+patch_database (const char  *desktop_dir,
+                char       **relative_paths,
+                GError     **error)
+{
+  GHashTable *patched_paths, *patched_ids, *patched_dirs;
+  GHashTableIter iter;
+  gpointer key, value;
+  StatsClock clock;
+  gboolean patchable;
+  int i;
+
+  if (!open_database (desktop_dir, error))
+    return TRUE;
+
+  stats_clock_start (&clock);
+
+  patched_paths = g_hash_table_new (g_str_hash, g_str_equal);
+  patched_ids = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       (GDestroyNotify) g_free, NULL);
+  patched_dirs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        (GDestroyNotify) g_free, NULL);
+  for (i = 0; relative_paths[i] != NULL; i++)
+    {
+      const char *slash;
+
+      g_hash_table_add (patched_paths, relative_paths[i]);
+      g_hash_table_add (patched_ids, get_desktop_id (relative_paths[i]));
+
+      /* the subdirectories of the patched files changed with them */
+      slash = strrchr (relative_paths[i], '/');
+      if (slash != NULL)
+        g_hash_table_add (patched_dirs,
+                          g_strndup (relative_paths[i],
+                                     slash + 1 - relative_paths[i]));
+    }
+
+  old_manifest = load_manifest (desktop_dir);
+  patchable = (old_manifest != NULL &&
+               manifest_matches_cache (desktop_dir) &&
+               manifest_matches_directory (patched_paths, patched_dirs));
+
+  /* a/b.desktop and a-b.desktop have the same desktop ID: removing the
+   * associations of one would remove those of the other */
+  if (patchable)
+    {
+      g_hash_table_iter_init (&iter, old_manifest);
+      while (patchable && g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          char *desktop_id;
+
+          if (((char *) key)[0] == '\0' ||
+              g_hash_table_contains (patched_paths, key))
+            continue;
+
+          desktop_id = get_desktop_id (key);
+          patchable = !g_hash_table_contains (patched_ids, desktop_id);
+          g_free (desktop_id);
+        }
+    }
+
+  if (patchable)
+    patchable = load_cache (desktop_dir);
+
+  if (!patchable)
+    {
+      g_hash_table_destroy (patched_dirs);
+      g_hash_table_destroy (patched_ids);
+      g_hash_table_destroy (patched_paths);
+      close_database ();
+      return FALSE;
+    }
+
+  g_hash_table_iter_init (&iter, patched_ids);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    uncache_desktop_file (g_string_chunk_insert_const (strings, key));
+
+  new_manifest = g_string_new (MANIFEST_HEADER);
+  g_hash_table_iter_init (&iter, old_manifest);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      ManifestEntry *entry = value;
+
+      if (((char *) key)[0] == '\0' ||
+          g_hash_table_contains (patched_paths, key))
+        continue;
+
+      if (entry->state == MANIFEST_STATE_DIRECTORY &&
+          g_hash_table_contains (patched_dirs, key))
+        {
+          struct stat buf;
+
+          if (fstatat (desktop_dir_fd, key, &buf, 0) == 0)
+            manifest_add_entry (key, &buf, MANIFEST_STATE_DIRECTORY, NULL);
+          continue;
+        }
+
+      manifest_append (key, entry->state, entry->mtime, entry->mtime_nsec,
+                       entry->size, entry->inode, entry->mime_types);
+    }
+
+  stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_TRAVERSE);
+
+  for (i = 0; relative_paths[i] != NULL; i++)
+    {
+      DesktopFileJob *job;
+
+      /* a file given more than once is only processed once */
+      if (!g_hash_table_remove (patched_paths, relative_paths[i]))
+        continue;
+
+      job = desktop_file_job_new ();
+      job->relative_path = g_strdup (relative_paths[i]);
+      job->name = get_desktop_id (relative_paths[i]);
+
+      /* the associations of a removed file are simply gone */
+      if (fstatat (desktop_dir_fd, job->relative_path, &job->buf, 0) == 0)
+        {
+          job->have_stat = TRUE;
+          job->accepted = g_string_new (NULL);
+          if (stats != NULL)
+            stats->files_scanned++;
+
+          process_desktop_file (job);
+          merge_desktop_file_job (job);
+        }
+
+      desktop_file_job_free (job);
+    }
+
+  stats_clock_add (&clock, DFU_MIME_CACHE_PHASE_PARSE);
+
+  write_database (desktop_dir, error);
+
+  g_hash_table_destroy (patched_dirs);
+  g_hash_table_destroy (patched_ids);
+  g_hash_table_destroy (patched_paths);
+  close_database ();
+
+  return TRUE;
+}
+
+static void
+set_options (const DfuMimeCacheOptions *options,
+             DfuMimeCacheStats         *update_stats)
+{
+  quiet        = options->quiet;
+  verbose      = options->verbose;
+  incremental  = options->incremental;
+  binary_index = options->binary_index;
+  jobs         = MAX (options->jobs, 1);
+  read_order   = options->read_order;
+  stats        = update_stats;
+}
+
+/* Updates the cache of MIME types of @desktop_dir, the way
+ * update-desktop-database does. When @update_stats is not %NULL, the
+ * statistics of the update are added to it. Messages are printed on the
+ * standard error, depending on @options. */
+void
+dfu_mime_cache_update (const char                *desktop_dir,
+                       const DfuMimeCacheOptions *options,
+                       DfuMimeCacheStats         *update_stats,
+                       GError                   **error)
+{
+  g_return_if_fail (desktop_dir != NULL);
+  g_return_if_fail (options != NULL);
+
+  set_options (options, update_stats);
+
+  update_database (desktop_dir, error);
+
+  stats = NULL;
+}
+
+static gboolean
+has_manifest (const char *dir)
+{
+  char *manifest_file;
+  gboolean exists;
+
+  manifest_file = g_build_filename (dir, MANIFEST_FILENAME, NULL);
+  exists = g_file_test (manifest_file, G_FILE_TEST_IS_REGULAR);
+  g_free (manifest_file);
+
+  return exists;
+}
+
+/* Updates the cache of MIME types of @desktop_dir after the desktop files
+ * at @relative_paths, relative to @desktop_dir, were added, changed or
+ * removed. The other desktop files are not read when the cache and the
+ * manifest of a previous incremental update are still consistent; otherwise
+ * the whole cache is rebuilt. That update is incremental when @options say
+ * so or when the directory already has a manifest, which is then kept up to
+ * date for the next call. */
+void
+dfu_mime_cache_update_files (const char                *desktop_dir,
+                             char                     **relative_paths,
+                             const DfuMimeCacheOptions *options,
+                             DfuMimeCacheStats         *update_stats,
+                             GError                   **error)
+{
+  g_return_if_fail (desktop_dir != NULL);
+  g_return_if_fail (relative_paths != NULL);
+  g_return_if_fail (options != NULL);
+
+  set_options (options, update_stats);
+
+  if (!patch_database (desktop_dir, relative_paths, error))
+    {
+      cache_verbose_print (_("Cache in \"%s\" cannot be patched, rebuilding it\n"),
+                         desktop_dir);
+      /* a manifest is never created unless asked for: it would be an
+       * unexpected file in a package build root, for example */
+      if (!incremental)
+        incremental = has_manifest (desktop_dir);
+      update_database (desktop_dir, error);
+    }
+
+  stats = NULL;
+}
+
+/* Whether @name is the name of one of the files written in a desktop
+ * directory by dfu_mime_cache_update() */
+gboolean
+dfu_mime_cache_is_own_file (const char *name)
+{
+  return (strcmp (name, CACHE_FILENAME) == 0 ||
+          strcmp (name, INDEX_FILENAME) == 0 ||
+          strcmp (name, MANIFEST_FILENAME) == 0 ||
+          g_str_has_prefix (name, ".mimeinfo.cache.") ||
+          /* temporary file of g_file_set_contents() */
+          g_str_has_prefix (name, MANIFEST_FILENAME "."));
+}
@@ -0,0 +1,89 @@
+/* mimecache.h: maintains the mimetype<->desktop mapping cache
+ * vim: set ts=2 sw=2 et: */
+
+/*
+ * Copyright (C) 2004-2006  Red Hat, Inc.
+ * Copyright (C) 2006, 2008  Vincent Untz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __DFU_MIMECACHE_H__
+#define __DFU_MIMECACHE_H__
+
+#include <glib.h>
+
+/* Order in which desktop files are read; on rotating disks and cheap flash,
+ * reading in directory order means seeking between each file */
+typedef enum
+{
+  DFU_READ_ORDER_READDIR,
+  DFU_READ_ORDER_INODE,
+  DFU_READ_ORDER_EXTENT
+} DfuReadOrder;
+
+typedef struct
+{
+  gboolean      quiet;
+  gboolean      verbose;
+  /* only parse the desktop files that changed since the previous update */
+  gboolean      incremental;
+  /* also write the binary index */
+  gboolean      binary_index;
+  /* number of threads parsing desktop files */
+  int           jobs;
+  DfuReadOrder  read_order;
+} DfuMimeCacheOptions;
+
+typedef enum
+{
+  DFU_MIME_CACHE_PHASE_TRAVERSE,
+  DFU_MIME_CACHE_PHASE_PARSE,
+  DFU_MIME_CACHE_PHASE_SORT,
+  DFU_MIME_CACHE_PHASE_WRITE,
+  DFU_MIME_CACHE_N_PHASES
+} DfuMimeCachePhase;
+
+typedef struct
+{
+  char    *path;                /* for the caller, never set */
+  guint    files_scanned;
+  guint    skipped_not_desktop;
+  guint    skipped_hidden;
+  guint    skipped_no_mime_type;
+  guint    skipped_parse_error;
+  guint    unchanged;           /* reused from the manifest */
+  guint64  bytes_read;
+  guint    mime_types;
+  guint    associations;
+  gint64   wall_time[DFU_MIME_CACHE_N_PHASES];   /* in microseconds */
+  gint64   cpu_time[DFU_MIME_CACHE_N_PHASES];
+} DfuMimeCacheStats;
+
+void     dfu_mime_cache_update       (const char                *desktop_dir,
+                                      const DfuMimeCacheOptions *options,
+                                      DfuMimeCacheStats         *update_stats,
+                                      GError                   **error);
+
+void     dfu_mime_cache_update_files (const char                *desktop_dir,
+                                      char                     **relative_paths,
+                                      const DfuMimeCacheOptions *options,
+                                      DfuMimeCacheStats         *update_stats,
+                                      GError                   **error);
+
+gboolean dfu_mime_cache_is_own_file  (const char *name);
+
+#endif /* __DFU_MIMECACHE_H__ */
@@ -38,32 +38,41 @@
 
 #include "mimeutils.h"
 
-/* Not registered with IANA, but used on a free desktop */
-static const char *known_fdo_media_types[] = {
-  "inode", "x-content", "x-scheme-handler",
+typedef enum {
+  /* Not registered with IANA, but used on a free desktop */
+  MEDIA_TYPE_FDO,
+  MEDIA_TYPE_OLD_FDO,
+  /* Defined in RFC 2045/2046, RFC 2077 and RFC 8081 */
+  MEDIA_TYPE_DISCRETE,
+  /* Defined in RFC 2045/2046 */
+  MEDIA_TYPE_COMPOSITE,
+  MEDIA_TYPE_NOT_USED
+} MediaTypeKind;
+
+/* Sorted with strcmp(), for the binary search in lookup_media_type() */
+static const struct {
+  const char    *name;
+  MediaTypeKind  kind;
+} known_media_types[] = {
+  { "application",      MEDIA_TYPE_DISCRETE },
+  { "audio",            MEDIA_TYPE_DISCRETE },
   /* The chemical media type was never really proposed to IANA, but is
    * well-known and in use by various applications out there. There are
    * also some guidelines to not abuse it.
    *   http://www.ch.ic.ac.uk/chemime/ */
-  "chemical"
-};
-
-static const char *known_old_fdo_media_types[] = {
-  "x-directory"
-};
-
-/* Defined in RFC 2045/2046, RFC 2077 and RFC 8081 */
-static const char *registered_discrete_media_types[] = {
-  "application", "audio", "font", "image", "model", "text", "video"
-};
-
-/* Defined in RFC 2045/2046 */
-static const char *registered_composite_media_types[] = {
-  "message", "multipart"
-};
-
-static const char *registered_not_used_media_types[] = {
-  "example"
+  { "chemical",         MEDIA_TYPE_FDO },
+  { "example",          MEDIA_TYPE_NOT_USED },
+  { "font",             MEDIA_TYPE_DISCRETE },
+  { "image",            MEDIA_TYPE_DISCRETE },
+  { "inode",            MEDIA_TYPE_FDO },
+  { "message",          MEDIA_TYPE_COMPOSITE },
+  { "model",            MEDIA_TYPE_DISCRETE },
+  { "multipart",        MEDIA_TYPE_COMPOSITE },
+  { "text",             MEDIA_TYPE_DISCRETE },
+  { "video",            MEDIA_TYPE_DISCRETE },
+  { "x-content",        MEDIA_TYPE_FDO },
+  { "x-directory",      MEDIA_TYPE_OLD_FDO },
+  { "x-scheme-handler", MEDIA_TYPE_FDO }
 };
 
 /* A few mime types that are not valid strictly-speaking (or discouraged
@@ -97,12 +106,20 @@ static struct {
   { "zz-application/zz-winassoc-xls", "application/vnd.ms-excel" } /* alias to be added in shared-mime-info: https://bugs.freedesktop.org/show_bug.cgi?id=41989 */
 };
 
-#define IF_IS_IN(list, type)                  \
-  for (i = 0; i < G_N_ELEMENTS (list); i++) { \
-    if (strcmp (type, list[i]) == 0)          \
-      break;                                  \
-  }                                           \
-  if (i < G_N_ELEMENTS (list))
+/* Why a mime type is not valid, to format the error only when it is needed */
+typedef enum {
+  REASON_NONE,
+  REASON_NO_SUBTYPE,
+  REASON_EMPTY_SUBTYPE,
+  REASON_INVALID_SUBTYPE_CHAR,
+  REASON_OLD_MEDIA_TYPE,
+  REASON_INVALID_MEDIA_TYPE_CHAR,
+  REASON_X_MEDIA_TYPE,
+  REASON_COMPOSITE_MEDIA_TYPE,
+  REASON_NOT_USED_MEDIA_TYPE,
+  REASON_UNREGISTERED_MEDIA_TYPE,
+  REASON_ALIAS
+} MimeTypeReason;
 
 
 /* TODO: it might actually be nice to download at distcheck time all the
@@ -118,22 +135,88 @@ static struct {
  *  tspecials :=  "(" / ")" / "<" / ">" / "@" /
  *                "," / ";" / ":" / "\" / <">
  *                "/" / "[" / "]" / "?" / "="
+ *
+ * This is 1 for the characters that can be in a token. Bytes above 127 are
+ * accepted, like they always were.
  */
+static const guint8 mime_type_token_chars[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
 static gboolean
-is_valid_mime_type_char (const guchar c)
+is_token (const char *str,
+          gsize       length)
 {
-  char invalid_chars[] = "()<>@,;:\\\"/[]?=";
+  gsize i;
 
-  /* Filter out control chars and space */
-  if ((c <= 32) || (c == 127))
-    return FALSE;
-
-  if (memchr (invalid_chars, c, sizeof (invalid_chars)) != NULL)
-    return FALSE;
+  for (i = 0; i < length; i++) {
+    if (!mime_type_token_chars[(guchar) str[i]])
+      return FALSE;
+  }
 
   return TRUE;
 }
 
+/* Compares @str, of @length bytes, with the nul-terminated @name, in the same
+ * order as strcmp() */
+static int
+compare_with_length (const char *str,
+                     gsize       length,
+                     const char *name)
+{
+  gsize name_length;
+  int   ret;
+
+  name_length = strlen (name);
+  ret = memcmp (str, name, MIN (length, name_length));
+  if (ret != 0)
+    return ret;
+
+  return (length > name_length) - (length < name_length);
+}
+
+static int
+lookup_media_type (const char *media_type,
+                   gsize       length)
+{
+  int low, high;
+
+  low = 0;
+  high = G_N_ELEMENTS (known_media_types) - 1;
+
+  while (low <= high) {
+    int middle;
+    int cmp;
+
+    middle = (low + high) / 2;
+    cmp = compare_with_length (media_type, length,
+                               known_media_types[middle].name);
+    if (cmp == 0)
+      return middle;
+    else if (cmp < 0)
+      high = middle - 1;
+    else
+      low = middle + 1;
+  }
+
+  return -1;
+}
+
 /* From the BNF grammar:
  *
  *    x-token := <The two characters "X-" or "x-" followed, with
@@ -146,149 +229,290 @@ is_valid_mime_type_char (const guchar c)
  *   appropriate than a new top-level type.
  */
 static MimeUtilsValidity
-is_valid_media_type (const char  *media_type,
-                     char       **error)
+is_valid_media_type (const char     *media_type,
+                     gsize           length,
+                     MimeTypeReason *reason)
 {
-  unsigned int i;
-
-  /* Handle known_fdo_media_types before X- types because it contains one X-
-   * type */
-  IF_IS_IN (known_fdo_media_types, media_type)
-    return MU_VALID;
-
-  IF_IS_IN (known_old_fdo_media_types, media_type) {
-    if (error)
-      *error = g_strdup_printf ("\"%s\" is an old media type that should be "
-                                "replaced with a modern equivalent", media_type);
-    return MU_DISCOURAGED;
-  }
-
-  if (g_ascii_strncasecmp (media_type, "X-", 2) == 0) {
-    for (i = 2; media_type[i]; i++) {
-      if (!is_valid_mime_type_char (media_type[i])) {
-        if (error)
-          *error = g_strdup_printf ("\"%s\" a media type that contains "
-                                    "an invalid character", media_type);
+  int i;
+
+  /* Known media types are looked up before X- types because some of them
+   * are X- types */
+  i = lookup_media_type (media_type, length);
+  if (i >= 0) {
+    switch (known_media_types[i].kind) {
+      case MEDIA_TYPE_FDO:
+      case MEDIA_TYPE_DISCRETE:
+        return MU_VALID;
+      case MEDIA_TYPE_OLD_FDO:
+        *reason = REASON_OLD_MEDIA_TYPE;
+        return MU_DISCOURAGED;
+      case MEDIA_TYPE_COMPOSITE:
+        *reason = REASON_COMPOSITE_MEDIA_TYPE;
+        return MU_DISCOURAGED;
+      case MEDIA_TYPE_NOT_USED:
+        *reason = REASON_NOT_USED_MEDIA_TYPE;
         return MU_INVALID;
-      }
+      default:
+        g_assert_not_reached ();
     }
-
-    if (error)
-      *error = g_strdup_printf ("the use of \"%s\" as media type is strongly "
-                                "discouraged in favor of a subtype of the "
-                                "\"application\" media type", media_type);
-
-    return MU_DISCOURAGED;
   }
 
-  IF_IS_IN (registered_discrete_media_types, media_type)
-    return MU_VALID;
+  if (length >= 2 && g_ascii_strncasecmp (media_type, "X-", 2) == 0) {
+    if (!is_token (media_type + 2, length - 2)) {
+      *reason = REASON_INVALID_MEDIA_TYPE_CHAR;
+      return MU_INVALID;
+    }
 
-  IF_IS_IN (registered_composite_media_types, media_type) {
-    if (error)
-      *error = g_strdup_printf ("\"%s\" is a media type that probably does "
-                                "not make sense in this context", media_type);
+    *reason = REASON_X_MEDIA_TYPE;
     return MU_DISCOURAGED;
   }
 
-  IF_IS_IN (registered_not_used_media_types, media_type) {
-    if (error)
-      *error = g_strdup_printf ("\"%s\" is a media type that must not "
-                                "be used", media_type);
-    return MU_INVALID;
-  }
+  *reason = REASON_UNREGISTERED_MEDIA_TYPE;
+  return MU_INVALID;
+}
 
-  if (error)
-    *error = g_strdup_printf ("\"%s\" is an unregistered media type",
-                              media_type);
+static char *
+format_error (const char     *mime_type,
+              gsize           length,
+              gsize           media_type_length,
+              MimeTypeReason  reason,
+              int             alias)
+{
+  int l = (int) length;
+  int m = (int) media_type_length;
+
+  switch (reason) {
+    case REASON_NO_SUBTYPE:
+      return g_strdup_printf ("\"%.*s\" does not contain a subtype",
+                              l, mime_type);
+    case REASON_EMPTY_SUBTYPE:
+      return g_strdup_printf ("\"%.*s\" contains an empty subtype",
+                              l, mime_type);
+    case REASON_INVALID_SUBTYPE_CHAR:
+      return g_strdup_printf ("\"%.*s\" contains an invalid character in "
+                              "the subtype", l, mime_type);
+    case REASON_OLD_MEDIA_TYPE:
+      return g_strdup_printf ("\"%.*s\" is an old media type that should be "
+                              "replaced with a modern equivalent",
+                              m, mime_type);
+    case REASON_INVALID_MEDIA_TYPE_CHAR:
+      return g_strdup_printf ("\"%.*s\" a media type that contains "
+                              "an invalid character", m, mime_type);
+    case REASON_X_MEDIA_TYPE:
+      return g_strdup_printf ("the use of \"%.*s\" as media type is strongly "
+                              "discouraged in favor of a subtype of the "
+                              "\"application\" media type", m, mime_type);
+    case REASON_COMPOSITE_MEDIA_TYPE:
+      return g_strdup_printf ("\"%.*s\" is a media type that probably does "
+                              "not make sense in this context", m, mime_type);
+    case REASON_NOT_USED_MEDIA_TYPE:
+      return g_strdup_printf ("\"%.*s\" is a media type that must not "
+                              "be used", m, mime_type);
+    case REASON_UNREGISTERED_MEDIA_TYPE:
+      return g_strdup_printf ("\"%.*s\" is an unregistered media type",
+                              m, mime_type);
+    case REASON_ALIAS:
+      return g_strdup_printf ("\"%.*s\" should be replaced with \"%s\"",
+                              l, mime_type,
+                              alias_to_replace_mime_types[alias].should_be);
+    case REASON_NONE:
+    default:
+      g_assert_not_reached ();
+  }
 
-  return MU_INVALID;
+  return NULL;
 }
 
+/* Same as mu_mime_type_is_valid(), for the @length bytes at @mime_type, which
+ * do not need to be nul-terminated. Nothing is allocated, except the error
+ * when the mime type is not valid and @error is not %NULL. */
 MimeUtilsValidity
-mu_mime_type_is_valid (const char  *mime_type,
-                       char       **error)
+mu_mime_type_is_valid_len (const char  *mime_type,
+                           gsize        length,
+                           char       **error)
 {
+  const char *slash;
+  gsize media_type_length;
+  MimeUtilsValidity validity;
+  MimeTypeReason reason;
   unsigned int i;
-  char *media_type;
-  char *subtype;
-  MimeUtilsValidity media_type_validity;
+  int alias;
 
   if (error)
     *error = NULL;
 
-  media_type = g_strdup (mime_type);
-  subtype = strchr (media_type, '/');
+  reason = REASON_NONE;
+  alias = -1;
 
-  if (!subtype) {
-    if (error)
-      *error = g_strdup_printf ("\"%s\" does not contain a subtype",
-                                mime_type);
-    g_free (media_type);
-    return MU_INVALID;
-  }
+  slash = memchr (mime_type, '/', length);
+  media_type_length = slash ? (gsize) (slash - mime_type) : length;
 
-  subtype[0] = '\0';
-  subtype++;
+  validity = MU_INVALID;
 
-  if (subtype[0] == '\0') {
-    if (error)
-      *error = g_strdup_printf ("\"%s\" contains an empty subtype",
-                                mime_type);
-    g_free (media_type);
-    return MU_INVALID;
+  if (!slash) {
+    reason = REASON_NO_SUBTYPE;
+    goto out;
   }
 
-  for (; subtype[0] != '\0'; subtype++) {
-      if (!is_valid_mime_type_char (subtype[0])) {
-        if (error)
-          *error = g_strdup_printf ("\"%s\" contains an invalid character in "
-                                    "the subtype", mime_type);
+  if (media_type_length + 1 == length) {
+    reason = REASON_EMPTY_SUBTYPE;
+    goto out;
+  }
 
-        g_free (media_type);
-        return MU_INVALID;
-      }
+  if (!is_token (slash + 1, length - media_type_length - 1)) {
+    reason = REASON_INVALID_SUBTYPE_CHAR;
+    goto out;
   }
 
-  media_type_validity = is_valid_media_type (media_type, error);
-  g_free (media_type);
+  validity = is_valid_media_type (mime_type, media_type_length, &reason);
 
   /* Let's end with the exceptions. We do this at the end to avoid doing more
    * work in most cases. */
+  if (validity == MU_VALID)
+    return MU_VALID;
 
-  if (media_type_validity != MU_VALID) {
-    IF_IS_IN (valid_exceptions_mime_types, mime_type) {
-      if (error && *error) {
-        g_free (*error);
-        *error = NULL;
-      }
-
+  for (i = 0; i < G_N_ELEMENTS (valid_exceptions_mime_types); i++) {
+    if (compare_with_length (mime_type, length,
+                             valid_exceptions_mime_types[i]) == 0)
       return MU_VALID;
-    }
   }
 
   /* If the mime type is already discouraged, then it won't be an improvement
    * to say that it's discouraged because it's an alias to something else. So
    * we just handle invalid mime types here. */
-  if (media_type_validity == MU_INVALID) {
+  if (validity == MU_INVALID) {
     for (i = 0; i < G_N_ELEMENTS (alias_to_replace_mime_types); i++) {
-      if (strcmp (mime_type, alias_to_replace_mime_types[i].mime_type) == 0)
+      if (compare_with_length (mime_type, length,
+                               alias_to_replace_mime_types[i].mime_type) == 0) {
+        reason = REASON_ALIAS;
+        alias = i;
+        validity = MU_DISCOURAGED;
         break;
+      }
     }
+  }
 
-    if (i < G_N_ELEMENTS (alias_to_replace_mime_types)) {
-      if (error) {
-        if (*error)
-          g_free (*error);
+out:
+  if (error && validity != MU_VALID)
+    *error = format_error (mime_type, length, media_type_length,
+                           reason, alias);
 
-        *error = g_strdup_printf ("\"%s\" should be replaced with \"%s\"",
-                                  mime_type,
-                                  alias_to_replace_mime_types[i].should_be);
-      }
+  return validity;
+}
 
-      return MU_DISCOURAGED;
-    }
+MimeUtilsValidity
+mu_mime_type_is_valid (const char  *mime_type,
+                       char       **error)
+{
+  return mu_mime_type_is_valid_len (mime_type, strlen (mime_type), error);
+}
+
+/* Validity of the mime types already seen, keyed by their interned string.
+ * The entries are never freed, like interned strings. */
+typedef struct {
+  MimeUtilsValidity  validity;
+  char              *error;
+} MimeTypeMemo;
+
+static GMutex      memo_mutex;
+static GHashTable *memo_table = NULL;
+
+/* Must be called with memo_mutex held */
+static MimeTypeMemo *
+memo_lookup (const char *interned)
+{
+  MimeTypeMemo *memo;
+
+  if (memo_table == NULL)
+    memo_table = g_hash_table_new (NULL, NULL);
+
+  memo = g_hash_table_lookup (memo_table, interned);
+  if (memo == NULL) {
+    memo = g_new (MimeTypeMemo, 1);
+    memo->validity = mu_mime_type_is_valid (interned, &memo->error);
+    g_hash_table_insert (memo_table, (gpointer) interned, memo);
+  }
+
+  return memo;
+}
+
+/* Same as mu_mime_type_is_valid(), but the result is computed only once per
+ * process for each mime type. The error, if any, must not be freed. This is
+ * safe to call from several threads. */
+MimeUtilsValidity
+mu_mime_type_is_valid_cached (const char  *mime_type,
+                              const char **error)
+{
+  const char   *interned;
+  MimeTypeMemo *memo;
+
+  interned = g_intern_string (mime_type);
+
+  g_mutex_lock (&memo_mutex);
+  memo = memo_lookup (interned);
+  g_mutex_unlock (&memo_mutex);
+
+  if (error)
+    *error = memo->error;
+
+  return memo->validity;
+}
+
+/* Validates all the mime types of the value of a MimeType key, separated by
+ * semicolons. Like with g_key_file_get_string_list(), empty elements are
+ * kept, but a final semicolon ends the list instead of adding an empty
+ * element: "a;;b;" gives "a", "" and "b". Returns an array of @n_results results in the
+ * order of the list, to free with g_free(); the strings of the results must
+ * not be freed. This is safe to call from several threads. */
+MimeUtilsResult *
+mu_mime_type_list_validate (const char *value,
+                            guint      *n_results)
+{
+  GArray     *results;
+  GString    *mime_type;
+  const char *start;
+  const char *end;
+  guint       i;
+
+  results = g_array_new (FALSE, FALSE, sizeof (MimeUtilsResult));
+  mime_type = g_string_new (NULL);
+
+  /* the strings are interned before taking the lock: g_intern_string() takes
+   * its own lock */
+  start = value;
+  while (*start != '\0') {
+    MimeUtilsResult result;
+
+    end = strchr (start, ';');
+    if (end == NULL)
+      end = start + strlen (start);
+
+    g_string_truncate (mime_type, 0);
+    g_string_append_len (mime_type, start, end - start);
+
+    result.mime_type = g_intern_string (mime_type->str);
+    g_array_append_val (results, result);
+
+    if (*end == '\0')
+      break;
+    start = end + 1;
   }
 
-  return media_type_validity;
+  g_string_free (mime_type, TRUE);
+
+  g_mutex_lock (&memo_mutex);
+  for (i = 0; i < results->len; i++) {
+    MimeUtilsResult *result;
+    MimeTypeMemo    *memo;
+
+    result = &g_array_index (results, MimeUtilsResult, i);
+    memo = memo_lookup (result->mime_type);
+    result->validity = memo->validity;
+    result->error = memo->error;
+  }
+  g_mutex_unlock (&memo_mutex);
+
+  *n_results = results->len;
+
+  return (MimeUtilsResult *) g_array_free (results, FALSE);
 }
@@ -33,7 +33,21 @@ typedef enum {
   MU_INVALID
 } MimeUtilsValidity;
 
-MimeUtilsValidity mu_mime_type_is_valid (const char  *mime_type,
-                                         char       **error);
+MimeUtilsValidity mu_mime_type_is_valid     (const char  *mime_type,
+                                             char       **error);
+MimeUtilsValidity mu_mime_type_is_valid_len (const char  *mime_type,
+                                             gsize        length,
+                                             char       **error);
+
+typedef struct {
+  const char        *mime_type;
+  MimeUtilsValidity  validity;
+  const char        *error;
+} MimeUtilsResult;
+
+MimeUtilsValidity mu_mime_type_is_valid_cached (const char  *mime_type,
+                                                const char **error);
+MimeUtilsResult  *mu_mime_type_list_validate   (const char  *value,
+                                                guint       *n_results);
 
 #endif /* __DFU_MIMEUTILS_H__ */
@@ -26,370 +26,421 @@
 
 #include <config.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <unistd.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <gio/gio.h>
 
-#include "keyfileutils.h"
-#include "mimeutils.h"
+#include "mimecache.h"
 
 #define NAME "update-desktop-database"
-#define CACHE_FILENAME "mimeinfo.cache"
-#define TEMP_CACHE_FILENAME_PREFIX ".mimeinfo.cache.XXXXXX"
 
 #define udd_print(...) if (!quiet) g_printerr (__VA_ARGS__)
 #define udd_verbose_print(...) if (!quiet && verbose) g_printerr (__VA_ARGS__)
 
-static FILE *open_temp_cache_file (const char  *dir,
-                                   char       **filename,
-                                   GError     **error);
-static void add_mime_type (const char *mime_type, GList *desktop_files, FILE *f);
-static void sync_database (const char *dir, GError **error);
-static void cache_desktop_file (const char  *desktop_file,
-                                const char  *mime_type,
-                                GError     **error);
-static void process_desktop_file (const char  *desktop_file,
-                                  const char  *name,
-                                  GError     **error);
-static void process_desktop_files (const char *desktop_dir,
-                                   const char *prefix,
-                                   GError **error);
 static void update_database (const char *desktop_dir, GError **error);
 static const char ** get_default_search_path (void);
 static void print_desktop_dirs (const char **dirs);
 
-static GHashTable *mime_types_map = NULL;
 static gboolean verbose = FALSE, quiet = FALSE, print_version = FALSE;
+static gboolean incremental = FALSE;
+static gboolean binary_index = FALSE;
+static gboolean watch = FALSE;
+static int debounce = 500;
+static int jobs = 1;
 
-static void
-list_free_deep (gpointer key, GList *l, gpointer data)
-{
-  g_list_foreach (l, (GFunc)g_free, NULL);
-  g_list_free (l);
-}
+static char *read_order_name = NULL;
+static DfuReadOrder read_order = DFU_READ_ORDER_READDIR;
 
-static void
-cache_desktop_file (const char  *desktop_file,
-                    const char  *mime_type,
-                    GError     **error)
+/* Statistics collected with --stats */
+typedef enum
 {
-  GList *desktop_files;
+  STATS_NONE,
+  STATS_TEXT,
+  STATS_JSON
+} StatsFormat;
 
-  desktop_files = (GList *) g_hash_table_lookup (mime_types_map, mime_type);
+static const char *stats_phase_names[DFU_MIME_CACHE_N_PHASES] = {
+  "traverse", "parse", "sort", "write"
+};
 
-  /* do not add twice a desktop file mentioning the mime type more than once
-   * (no need to use g_list_find() because we cache all mime types registered
-   * by a desktop file before moving to another desktop file) */
-  if (desktop_files &&
-      strcmp (desktop_file, (const char *) desktop_files->data) == 0)
-    return;
+static StatsFormat stats_format = STATS_NONE;
+static GPtrArray *all_stats = NULL;
 
-  desktop_files = g_list_prepend (desktop_files, g_strdup (desktop_file));
-  g_hash_table_insert (mime_types_map, g_strdup (mime_type), desktop_files);
+static void
+stats_free (DfuMimeCacheStats *update_stats)
+{
+  g_free (update_stats->path);
+  g_slice_free (DfuMimeCacheStats, update_stats);
 }
 
-
 static void
-process_desktop_file (const char  *desktop_file,
-                      const char  *name,
-                      GError     **error)
+stats_add (DfuMimeCacheStats       *total,
+           const DfuMimeCacheStats *update_stats)
 {
-  GError *load_error;
-  GKeyFile *keyfile;
-  char **mime_types;
   int i;
 
-  keyfile = g_key_file_new ();
-
-  load_error = NULL;
-  g_key_file_load_from_file (keyfile, desktop_file,
-                             G_KEY_FILE_NONE, &load_error);
-
-  if (load_error != NULL)
+  total->files_scanned += update_stats->files_scanned;
+  total->skipped_not_desktop += update_stats->skipped_not_desktop;
+  total->skipped_hidden += update_stats->skipped_hidden;
+  total->skipped_no_mime_type += update_stats->skipped_no_mime_type;
+  total->skipped_parse_error += update_stats->skipped_parse_error;
+  total->unchanged += update_stats->unchanged;
+  total->bytes_read += update_stats->bytes_read;
+  total->mime_types += update_stats->mime_types;
+  total->associations += update_stats->associations;
+
+  for (i = 0; i < DFU_MIME_CACHE_N_PHASES; i++)
     {
-      g_propagate_error (error, load_error);
-      return;
+      total->wall_time[i] += update_stats->wall_time[i];
+      total->cpu_time[i] += update_stats->cpu_time[i];
     }
+}
 
-  /* Hidden=true means that the .desktop file should be completely ignored */
-  if (g_key_file_get_boolean (keyfile, GROUP_DESKTOP_ENTRY, "Hidden", NULL))
-    {
-      g_key_file_free (keyfile);
-      return;
-    }
+static void
+print_stats_text (const DfuMimeCacheStats *update_stats)
+{
+  int i;
+
+  if (update_stats->path != NULL)
+    g_print (_("Statistics for \"%s\":\n"), update_stats->path);
+  else
+    g_print (_("Total:\n"));
+
+  g_print (_("  files scanned: %u\n"), update_stats->files_scanned);
+  g_print (_("  skipped, not a desktop file: %u\n"),
+           update_stats->skipped_not_desktop);
+  g_print (_("  skipped, hidden: %u\n"), update_stats->skipped_hidden);
+  g_print (_("  skipped, no MimeType key: %u\n"),
+           update_stats->skipped_no_mime_type);
+  g_print (_("  skipped, parse error: %u\n"),
+           update_stats->skipped_parse_error);
+  g_print (_("  unchanged since the previous run: %u\n"),
+           update_stats->unchanged);
+  g_print (_("  bytes read: %" G_GUINT64_FORMAT "\n"), update_stats->bytes_read);
+  g_print (_("  MIME types: %u\n"), update_stats->mime_types);
+  g_print (_("  associations: %u\n"), update_stats->associations);
+
+  for (i = 0; i < DFU_MIME_CACHE_N_PHASES; i++)
+    g_print (_("  %s: %.3f s wall, %.3f s CPU\n"), stats_phase_names[i],
+             update_stats->wall_time[i] / (double) G_USEC_PER_SEC,
+             update_stats->cpu_time[i] / (double) G_USEC_PER_SEC);
+}
 
-  mime_types = g_key_file_get_string_list (keyfile,
-                                           GROUP_DESKTOP_ENTRY,
-                                           "MimeType", NULL, &load_error);
+static void
+append_json_stats (GString                 *json,
+                   const DfuMimeCacheStats *update_stats)
+{
+  int i;
 
-  g_key_file_free (keyfile);
+  g_string_append_c (json, '{');
 
-  if (load_error != NULL)
+  if (update_stats->path != NULL)
     {
-      g_propagate_error (error, load_error);
-      return;
-    }
+      char *display_name;
+      const char *p;
 
-  for (i = 0; mime_types[i] != NULL; i++)
-    {
-      char *mime_type;
-      MimeUtilsValidity valid;
-      char *valid_error;
-
-      mime_type = g_strchomp (mime_types[i]);
-      valid = mu_mime_type_is_valid (mime_types[i], &valid_error);
-      switch (valid)
-      {
-        case MU_VALID:
-          break;
-        case MU_DISCOURAGED:
-          udd_print (_("Warning in file \"%s\": usage of MIME type \"%s\" is "
-                       "discouraged (%s)\n"),
-                     desktop_file, mime_types[i], valid_error);
-          g_free (valid_error);
-          break;
-        case MU_INVALID:
-          udd_print (_("Error in file \"%s\": \"%s\" is an invalid MIME type "
-                       "(%s)\n"),
-                     desktop_file, mime_types[i], valid_error);
-          g_free (valid_error);
-          /* not a break: we continue to the next mime type */
-          continue;
-        default:
-          g_assert_not_reached ();
-      }
-
-      cache_desktop_file (name, mime_type, &load_error);
-
-      if (load_error != NULL)
+      /* JSON strings must be valid UTF-8 */
+      display_name = g_filename_display_name (update_stats->path);
+      g_string_append (json, "\"path\":\"");
+      for (p = display_name; *p != '\0'; p++)
         {
-          g_propagate_error (error, load_error);
-          g_strfreev (mime_types);
-          return;
+          if (*p == '"' || *p == '\\')
+            g_string_append_printf (json, "\\%c", *p);
+          else if ((guchar) *p < 0x20)
+            g_string_append_printf (json, "\\u%04x", (guchar) *p);
+          else
+            g_string_append_c (json, *p);
         }
+      g_string_append (json, "\",");
+      g_free (display_name);
     }
-  g_strfreev (mime_types);
+
+  g_string_append_printf (json,
+                          "\"files_scanned\":%u,"
+                          "\"skipped\":{\"not_desktop\":%u,\"hidden\":%u,"
+                          "\"no_mime_type\":%u,\"parse_error\":%u},"
+                          "\"unchanged\":%u,"
+                          "\"bytes_read\":%" G_GUINT64_FORMAT ","
+                          "\"mime_types\":%u,\"associations\":%u,"
+                          "\"phases\":{",
+                          update_stats->files_scanned,
+                          update_stats->skipped_not_desktop,
+                          update_stats->skipped_hidden,
+                          update_stats->skipped_no_mime_type,
+                          update_stats->skipped_parse_error,
+                          update_stats->unchanged,
+                          update_stats->bytes_read,
+                          update_stats->mime_types,
+                          update_stats->associations);
+
+  for (i = 0; i < DFU_MIME_CACHE_N_PHASES; i++)
+    g_string_append_printf (json,
+                            "%s\"%s\":{\"wall_us\":%" G_GINT64_FORMAT ","
+                            "\"cpu_us\":%" G_GINT64_FORMAT "}",
+                            i > 0 ? "," : "", stats_phase_names[i],
+                            update_stats->wall_time[i],
+                            update_stats->cpu_time[i]);
+
+  g_string_append (json, "}}");
 }
 
+/* Prints the statistics of the directories updated since the last call, on
+ * the standard output */
 static void
-process_desktop_files (const char  *desktop_dir,
-                       const char  *prefix,
-                       GError     **error)
+print_stats (void)
 {
-  GError *process_error;
-  GDir *dir;
-  const char *filename;
+  DfuMimeCacheStats total = { NULL, };
+  struct rusage usage;
+  glong peak_rss;
+  guint i;
 
-  process_error = NULL;
-  dir = g_dir_open (desktop_dir, 0, &process_error);
+  if (all_stats == NULL)
+    return;
 
-  if (process_error != NULL)
-    {
-      g_propagate_error (error, process_error);
-      return;
-    }
+  for (i = 0; i < all_stats->len; i++)
+    stats_add (&total, g_ptr_array_index (all_stats, i));
 
-  while ((filename = g_dir_read_name (dir)) != NULL)
-    {
-      char *full_path, *name;
+  /* in kilobytes on Linux and the BSDs */
+  peak_rss = 0;
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    peak_rss = usage.ru_maxrss;
 
-      full_path = g_build_filename (desktop_dir, filename, NULL);
+  if (stats_format == STATS_JSON)
+    {
+      GString *json;
 
-      if (g_file_test (full_path, G_FILE_TEST_IS_DIR))
-        {
-          char *sub_prefix;
-
-          sub_prefix = g_strdup_printf ("%s%s-", prefix, filename);
-
-          process_desktop_files (full_path, sub_prefix, &process_error);
-          g_free (sub_prefix);
-
-          if (process_error != NULL)
-            {
-              udd_verbose_print (_("Could not process directory \"%s\": %s\n"),
-                                 full_path, process_error->message);
-              g_error_free (process_error);
-              process_error = NULL;
-            }
-          g_free (full_path);
-          continue;
-        }
-      else if (!g_str_has_suffix (filename, ".desktop"))
+      json = g_string_new ("{\"directories\":[");
+      for (i = 0; i < all_stats->len; i++)
         {
-          g_free (full_path);
-          continue;
+          if (i > 0)
+            g_string_append_c (json, ',');
+          append_json_stats (json, g_ptr_array_index (all_stats, i));
         }
+      g_string_append (json, "],\"total\":");
+      append_json_stats (json, &total);
+      g_string_append_printf (json, ",\"peak_rss_kib\":%ld}\n", peak_rss);
 
-      name = g_strdup_printf ("%s%s", prefix, filename);
-      process_desktop_file (full_path, name, &process_error);
-      g_free (name);
+      g_print ("%s", json->str);
+      g_string_free (json, TRUE);
+    }
+  else
+    {
+      for (i = 0; i < all_stats->len; i++)
+        print_stats_text (g_ptr_array_index (all_stats, i));
+      print_stats_text (&total);
+      g_print (_("Peak RSS: %ld KiB\n"), peak_rss);
+    }
 
-      if (process_error != NULL)
-        {
-          if (!g_error_matches (process_error,
-                                G_KEY_FILE_ERROR,
-                                G_KEY_FILE_ERROR_KEY_NOT_FOUND))
-            {
-              udd_print (_("Could not parse file \"%s\": %s\n"), full_path,
-                         process_error->message);
-            }
-          else
-            {
-              udd_verbose_print (_("File \"%s\" lacks MimeType key\n"),
-                                 full_path);
-            }
+  g_ptr_array_set_size (all_stats, 0);
+}
 
-          g_error_free (process_error);
-          process_error = NULL;
-        }
+static gboolean
+parse_stats_option (const char  *option_name,
+                    const char  *value,
+                    gpointer     data,
+                    GError     **error)
+{
+  if (value == NULL || strcmp (value, "text") == 0)
+    stats_format = STATS_TEXT;
+  else if (strcmp (value, "json") == 0)
+    stats_format = STATS_JSON;
+  else
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Unknown statistics format \"%s\""), value);
+      return FALSE;
+    }
 
-      g_free (full_path);
+  return TRUE;
+}
+
+static void
+update_database (const char  *desktop_dir,
+                 GError     **error)
+{
+  DfuMimeCacheOptions options;
+  DfuMimeCacheStats *update_stats;
+
+  options.quiet        = quiet;
+  options.verbose      = verbose;
+  options.incremental  = incremental;
+  options.binary_index = binary_index;
+  options.jobs         = jobs;
+  options.read_order   = read_order;
+
+  update_stats = NULL;
+  if (stats_format != STATS_NONE)
+    {
+      update_stats = g_slice_new0 (DfuMimeCacheStats);
+      update_stats->path = g_strdup (desktop_dir);
+      if (all_stats == NULL)
+        all_stats = g_ptr_array_new_with_free_func ((GDestroyNotify) stats_free);
+      g_ptr_array_add (all_stats, update_stats);
     }
 
-  g_dir_close (dir);
+  dfu_mime_cache_update (desktop_dir, &options, update_stats, error);
 }
 
-static FILE *
-open_temp_cache_file (const char *dir, char **filename, GError **error)
+/* A desktop directory monitored with --watch; each of its subdirectories
+ * needs its own monitor */
+typedef struct
 {
-  int fd;
-  char *file;
-  FILE *fp;
-  mode_t mask;
+  char       *path;
+  GPtrArray  *monitors;
+  GHashTable *visited;   /* "device:inode" of the monitored directories */
+  guint       timeout_id;
+} WatchedDir;
 
-  file = g_build_filename (dir, TEMP_CACHE_FILENAME_PREFIX, NULL);
-  fd = g_mkstemp (file);
+static void watch_directory_tree (WatchedDir *wd, const char *path);
 
-  if (fd < 0)
-    {
-      g_set_error (error, G_FILE_ERROR,
-                   g_file_error_from_errno (errno),
-                   "%s", g_strerror (errno));
-      g_free (file);
-      return NULL;
-    }
+static gboolean
+rebuild_watched_dir (gpointer data)
+{
+  WatchedDir *wd = data;
+  GError *error;
 
-  mask = umask(0);
-  (void) umask (mask);
+  wd->timeout_id = 0;
 
-  fchmod (fd, 0666 & ~mask);
+  udd_verbose_print (_("Updating cache in \"%s\"\n"), wd->path);
 
-  fp = fdopen (fd, "w+");
-  if (fp == NULL)
+  error = NULL;
+  update_database (wd->path, &error);
+  if (error != NULL)
     {
-      g_set_error (error, G_FILE_ERROR,
-                   g_file_error_from_errno (errno),
-                   "%s", g_strerror (errno));
-      g_free (file);
-      close (fd);
-      return NULL;
+      udd_verbose_print (_("Could not create cache file in \"%s\": %s\n"),
+                         wd->path, error->message);
+      g_error_free (error);
     }
 
-  if (filename)
-    *filename = file;
-  else
-    g_free (file);
+  print_stats ();
+
+  /* subdirectories may have been created or removed */
+  g_ptr_array_set_size (wd->monitors, 0);
+  g_hash_table_remove_all (wd->visited);
+  watch_directory_tree (wd, wd->path);
 
-  return fp;
+  return G_SOURCE_REMOVE;
 }
 
+/* Events are coalesced: the cache is only rebuilt once no event happened
+ * during the debounce delay */
 static void
-add_mime_type (const char *mime_type, GList *desktop_files, FILE *f)
+on_watched_dir_changed (GFileMonitor      *monitor,
+                        GFile             *file,
+                        GFile             *other_file,
+                        GFileMonitorEvent  event_type,
+                        WatchedDir        *wd)
 {
-  GString *list;
-  GList *desktop_file;
-
-  list = g_string_new (mime_type);
-  g_string_append_c (list, '=');
-  desktop_files = g_list_sort (desktop_files, (GCompareFunc) g_strcmp0);
-  for (desktop_file = desktop_files;
-       desktop_file != NULL;
-       desktop_file = desktop_file->next)
-    {
-      g_string_append (list, (const char *) desktop_file->data);
-      g_string_append_c (list, ';');
-    }
-  g_string_append_c (list, '\n');
+  char *name;
+  gboolean ignore;
+
+  if (event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+      event_type == G_FILE_MONITOR_EVENT_PRE_UNMOUNT)
+    return;
 
-  fputs (list->str, f);
+  name = g_file_get_basename (file);
+  ignore = dfu_mime_cache_is_own_file (name);
+  g_free (name);
 
-  g_string_free (list, TRUE);
+  if (ignore)
+    return;
+
+  if (wd->timeout_id != 0)
+    g_source_remove (wd->timeout_id);
+  wd->timeout_id = g_timeout_add (debounce, rebuild_watched_dir, wd);
 }
 
 static void
-sync_database (const char *dir, GError **error)
+watch_directory_tree (WatchedDir *wd,
+                      const char *path)
 {
-  GError *sync_error;
-  char *temp_cache_file, *cache_file;
-  FILE *tmp_file;
-  GList *keys, *key;
-
-  temp_cache_file = NULL;
-  sync_error = NULL;
-  tmp_file = open_temp_cache_file (dir, &temp_cache_file, &sync_error);
+  GFile *file;
+  GFileMonitor *monitor;
+  GError *error;
+  GDir *dir;
+  const char *filename;
+  struct stat buf;
 
-  if (sync_error != NULL)
+  /* directories are followed like in process_desktop_files(), but symlinks
+   * must not make us loop */
+  if (stat (path, &buf) == 0)
     {
-      g_propagate_error (error, sync_error);
-      return;
+      char *id;
+
+      id = g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                            (guint64) buf.st_dev, (guint64) buf.st_ino);
+      if (g_hash_table_contains (wd->visited, id))
+        {
+          g_free (id);
+          return;
+        }
+      g_hash_table_add (wd->visited, id);
     }
 
-  fputs ("[MIME Cache]\n", tmp_file);
+  error = NULL;
+  file = g_file_new_for_path (path);
+  monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, &error);
+  g_object_unref (file);
 
-  keys = g_hash_table_get_keys (mime_types_map);
-  keys = g_list_sort (keys, (GCompareFunc) g_strcmp0);
+  if (monitor == NULL)
+    {
+      udd_verbose_print (_("Could not watch directory \"%s\": %s\n"),
+                         path, error->message);
+      g_error_free (error);
+      return;
+    }
 
-  for (key = keys; key != NULL; key = key->next)
-    add_mime_type (key->data,
-                   g_hash_table_lookup (mime_types_map, key->data),
-                   tmp_file);
+  g_signal_connect (monitor, "changed",
+                    G_CALLBACK (on_watched_dir_changed), wd);
+  g_ptr_array_add (wd->monitors, monitor);
 
-  g_list_free (keys);
-  fclose (tmp_file);
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
 
-  cache_file = g_build_filename (dir, CACHE_FILENAME, NULL);
-  if (rename (temp_cache_file, cache_file) < 0)
+  while ((filename = g_dir_read_name (dir)) != NULL)
     {
-      g_set_error (error, G_FILE_ERROR,
-                   g_file_error_from_errno (errno),
-                   _("Cache file \"%s\" could not be written: %s"),
-                   cache_file, g_strerror (errno));
+      char *full_path;
 
-      unlink (temp_cache_file);
+      full_path = g_build_filename (path, filename, NULL);
+      if (g_file_test (full_path, G_FILE_TEST_IS_DIR))
+        watch_directory_tree (wd, full_path);
+      g_free (full_path);
     }
-  g_free (temp_cache_file);
-  g_free (cache_file);
+
+  g_dir_close (dir);
 }
 
+/* Runs forever, rebuilding the cache of a directory when something changes
+ * in it or in one of its subdirectories */
 static void
-update_database (const char  *desktop_dir,
-                 GError     **error)
+watch_desktop_dirs (const char **desktop_dirs)
 {
-  GError *update_error;
+  GMainLoop *loop;
+  int i;
 
-  mime_types_map = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                          (GDestroyNotify)g_free,
-                                          NULL);
+  for (i = 0; desktop_dirs[i] != NULL; i++)
+    {
+      WatchedDir *wd;
 
-  update_error = NULL;
-  process_desktop_files (desktop_dir, "", &update_error);
+      wd = g_slice_new0 (WatchedDir);
+      wd->path = g_strdup (desktop_dirs[i]);
+      wd->monitors = g_ptr_array_new_with_free_func (g_object_unref);
+      wd->visited = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, NULL);
 
-  if (update_error != NULL)
-    g_propagate_error (error, update_error);
-  else
-    {
-      sync_database (desktop_dir, &update_error);
-      if (update_error != NULL)
-        g_propagate_error (error, update_error);
+      udd_verbose_print (_("Watching \"%s\"\n"), wd->path);
+      watch_directory_tree (wd, wd->path);
     }
-  g_hash_table_foreach (mime_types_map, (GHFunc) list_free_deep, NULL);
-  g_hash_table_destroy (mime_types_map);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
 }
 
 static const char **
@@ -446,6 +497,41 @@ main (int    argc,
        N_("Display more information about processing and updating progress"),
        NULL},
 
+     { "incremental", 0, 0, G_OPTION_ARG_NONE, &incremental,
+       N_("Only parse desktop files that changed since the previous run, "
+          "using a manifest stored next to the cache"),
+       NULL},
+
+     { "binary-index", 0, 0, G_OPTION_ARG_NONE, &binary_index,
+       N_("Also write a binary index of the cache, that can be used "
+          "without parsing it"),
+       NULL},
+
+     { "watch", 0, 0, G_OPTION_ARG_NONE, &watch,
+       N_("Keep running and update the cache of a directory each time "
+          "a desktop file changes in it"),
+       NULL},
+
+     { "debounce", 0, 0, G_OPTION_ARG_INT, &debounce,
+       N_("With --watch, wait until no change happened for MS "
+          "milliseconds before updating a cache (default: 500)"),
+       N_("MS") },
+
+     { "read-order", 0, 0, G_OPTION_ARG_STRING, &read_order_name,
+       N_("Order in which desktop files are read: \"readdir\" (default), "
+          "\"inode\" or \"extent\" (location on the disk)"),
+       N_("ORDER") },
+
+     { "stats", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK,
+       parse_stats_option,
+       N_("Print statistics about each directory on the standard output, "
+          "as \"text\" (default) or \"json\""),
+       N_("FORMAT") },
+
+     { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+       N_("Parse desktop files using N threads (0 for one per processor)"),
+       N_("N") },
+
      { "version", 0, 0, G_OPTION_ARG_NONE, &print_version,
        N_("Show the program version"),
        NULL},
@@ -482,6 +568,27 @@ main (int    argc,
     return 0;
   }
 
+  if (jobs <= 0)
+    jobs = g_get_num_processors ();
+
+  if (read_order_name == NULL || strcmp (read_order_name, "readdir") == 0)
+    read_order = DFU_READ_ORDER_READDIR;
+  else if (strcmp (read_order_name, "inode") == 0)
+    read_order = DFU_READ_ORDER_INODE;
+  else if (strcmp (read_order_name, "extent") == 0)
+    read_order = DFU_READ_ORDER_EXTENT;
+  else
+    {
+      g_printerr (_("Unknown read order \"%s\"\n"), read_order_name);
+      return 1;
+    }
+
+  if (debounce < 0)
+    {
+      g_printerr (_("The debounce delay cannot be negative\n"));
+      return 1;
+    }
+
   if (desktop_dirs == NULL || desktop_dirs[0] == NULL)
     desktop_dirs = get_default_search_path ();
 
@@ -505,6 +612,8 @@ main (int    argc,
     }
   g_option_context_free (context);
 
+  print_stats ();
+
   if (!found_processable_dir)
     {
       char *directories;
@@ -515,8 +624,13 @@ main (int    argc,
 
       g_free (directories);
 
-      return 1;
+      /* the directories may still be created later */
+      if (!watch)
+        return 1;
     }
 
+  if (watch)
+    watch_desktop_dirs (desktop_dirs);
+
   return 0;
 }
@@ -32,6 +32,7 @@
  * USA.
  */
 
+#include <config.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -43,6 +44,7 @@
 #include <glib/gstdio.h>
 #include <gio/gio.h>
 
+#include "fileutils.h"
 #include "keyfileutils.h"
 #include "mimeutils.h"
 #include "validate.h"
@@ -103,7 +105,6 @@ typedef struct _kf_validator kf_validator;
 struct _kf_validator {
   const char  *filename;
 
-  GString     *parse_buffer;
   gboolean     utf8_warning;
   gboolean     cr_error;
 
@@ -131,7 +132,12 @@ struct _kf_validator {
 
   gboolean     fatal_error;
 
-  gboolean     use_colors;
+  /* of DesktopFileMessage */
+  GPtrArray   *messages;
+
+  /* group and key the messages are about, if any */
+  const char  *context_group;
+  const char  *context_key;
 
   gboolean     dbus_activatable;
 };
@@ -568,84 +574,301 @@ static struct {
   { "Applications",           FALSE, FALSE, TRUE,  { NULL }, { NULL } }
 };
 
-/* Escape values for console colors */
-#define UNDERLINE     "\033[4m"
-#define MAGENTA       "\033[35m"
-#define RED           "\033[31m"
-#define YELLOW        "\033[33m"
+/* The tables above are looked up through minimal perfect hashes generated at
+ * build time by gen-perfect-hash.py: the hash of a name with a seed of 0
+ * selects a bucket, and the seed of this bucket gives the only slot where the
+ * name can be. Only one string comparison is needed to know if the name is
+ * registered. */
+typedef struct {
+  const guint32 *seeds;
+  guint          n_seeds;
+  const gint16  *slots;
+  guint          n_slots;
+} PerfectHash;
+
+#include "validate-tables.h"
+
+/* FNV-1a with a final mix; this must be kept in sync with fnv1a() in
+ * gen-perfect-hash.py */
+static guint32
+perfect_hash_string (const char *str,
+                     guint32     seed)
+{
+  guint32 h;
 
-/* Colour definitions */
-#define RESET_COLOR        (kf->use_colors ? "\033[0m" : "")
-#define FILENAME_COLOR     (kf->use_colors ? UNDERLINE : "")
-#define FATAL_COLOR        (kf->use_colors ? RED : "")
-#define FUTURE_FATAL_COLOR (kf->use_colors ? RED : "")
-#define WARNING_COLOR      (kf->use_colors ? MAGENTA : "")
-#define HINT_COLOR         (kf->use_colors ? YELLOW : "")
+  h = 2166136261U ^ seed;
+  for (; *str != '\0'; str++) {
+    h ^= (guchar) *str;
+    h *= 16777619U;
+  }
+
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+
+  return h;
+}
+
+/* Returns the index in the table of the only candidate for str, or -1. The
+ * caller still has to compare str with the name at this index. */
+static int
+perfect_hash_lookup (const PerfectHash *hash,
+                     const char        *str)
+{
+  guint32 seed;
+
+  seed = hash->seeds[perfect_hash_string (str, 0) % hash->n_seeds];
+  return hash->slots[perfect_hash_string (str, seed) % hash->n_slots];
+}
+
+static gboolean
+is_registered_show_in (const char *value)
+{
+  int i;
+
+  i = perfect_hash_lookup (&show_in_registered_hash, value);
+  return i >= 0 && strcmp (value, show_in_registered[i]) == 0;
+}
+
+/* Returns the index of the category in registered_categories, or -1 */
+static int
+lookup_registered_category (const char *name)
+{
+  int i;
+
+  i = perfect_hash_lookup (&registered_categories_hash, name);
+  if (i < 0 || strcmp (name, registered_categories[i].name) != 0)
+    return -1;
+
+  return i;
+}
+
+/* Indexed by DesktopFileDiagnostic; those identifiers must never change */
+static const char *diagnostic_ids[] = {
+  "invalid-string-value",
+  "invalid-localestring-value",
+  "missing-unlocalized-key",
+  "invalid-boolean-value",
+  "deprecated-boolean-value",
+  "invalid-numeric-value",
+  "invalid-list-value",
+  "invalid-localestring-list-value",
+  "unregistered-type",
+  "kde-reserved-type",
+  "deprecated-type",
+  "unknown-version",
+  "comment-same-as-name",
+  "icon-is-directory",
+  "icon-is-relative-path",
+  "icon-name-with-extension",
+  "both-only-show-in-and-not-show-in",
+  "duplicate-show-in-value",
+  "unregistered-show-in-value",
+  "invalid-field-code",
+  "escaped-quote-outside-quote",
+  "unescaped-character-in-quote",
+  "reserved-character-outside-quote",
+  "incomplete-escape-sequence",
+  "multiple-file-field-codes",
+  "deprecated-field-code",
+  "unclosed-quote",
+  "incomplete-field-code",
+  "not-an-absolute-path",
+  "duplicate-mime-type",
+  "discouraged-mime-type",
+  "invalid-mime-type",
+  "duplicate-category",
+  "unregistered-category",
+  "multiple-main-categories",
+  "deprecated-category",
+  "reserved-category-without-only-show-in",
+  "missing-related-category",
+  "category-can-be-extended",
+  "no-main-category",
+  "empty-keyword",
+  "keyword-same-as-name",
+  "empty-action",
+  "duplicate-action",
+  "invalid-action-identifier",
+  "invalid-interface-name",
+  "duplicate-interface",
+  "dbus-filename-not-reverse-dns",
+  "unregistered-encoding",
+  "condition-without-path",
+  "condition-with-absolute-path",
+  "condition-with-parent-path",
+  "condition-trailing-space",
+  "condition-invalid-first-argument",
+  "condition-too-many-arguments",
+  "condition-too-few-arguments",
+  "unregistered-condition",
+  "key-not-localizable",
+  "deprecated-key",
+  "kde-reserved-key",
+  "unregistered-key",
+  "invalid-key-name",
+  "duplicate-key",
+  "invalid-group-name",
+  "redundant-groups",
+  "deprecated-group",
+  "action-group-without-name",
+  "unregistered-group",
+  "missing-required-key",
+  "missing-exec-key",
+  "recommended-exec-key",
+  "key-not-valid-for-type",
+  "action-without-group",
+  "action-group-without-action",
+  "invalid-filename-extension",
+  "deprecated-filename-extension",
+  "group-trailing-space",
+  "not-utf8",
+  "line-leading-space",
+  "first-group-not-desktop-entry",
+  "duplicate-group",
+  "entry-before-first-group",
+  "invalid-line",
+  "carriage-return",
+  "read-error",
+  "not-a-regular-file",
+  "empty-file",
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (diagnostic_ids) == DIAG_LAST);
+
+const char *
+desktop_file_diagnostic_get_id (DesktopFileDiagnostic code)
+{
+  g_return_val_if_fail (code < DIAG_LAST, NULL);
+
+  return diagnostic_ids[code];
+}
 
-G_GNUC_PRINTF (2, 3) static void
-print_fatal (kf_validator *kf, const char *format, ...)
+static void
+json_append_string (GString    *json,
+                    const char *str)
+{
+  const char *p;
+  const char *end;
+
+  if (str == NULL) {
+    g_string_append (json, "null");
+    return;
+  }
+
+  g_string_append_c (json, '"');
+
+  p = str;
+  end = str + strlen (str);
+  while (p < end) {
+    const char *valid_end;
+    guchar      c;
+
+    /* invalid UTF-8 (in file names, for example) is replaced */
+    if (!g_utf8_validate (p, end - p, &valid_end) && valid_end == p) {
+      g_string_append (json, "\\ufffd");
+      p++;
+      continue;
+    }
+
+    for (; p < valid_end; p++) {
+      c = (guchar) *p;
+      if (c == '"' || c == '\\') {
+        g_string_append_c (json, '\\');
+        g_string_append_c (json, c);
+      } else if (c == '\n')
+        g_string_append (json, "\\n");
+      else if (c == '\t')
+        g_string_append (json, "\\t");
+      else if (c < 0x20)
+        g_string_append_printf (json, "\\u%04x", c);
+      else
+        g_string_append_c (json, c);
+    }
+  }
+
+  g_string_append_c (json, '"');
+}
+
+/* Messages are collected, to be rendered once the file is validated. They
+ * are all written with a final newline, which is not kept. */
+static void
+validate_add_message (kf_validator          *kf,
+                      DesktopFileSeverity    severity,
+                      DesktopFileDiagnostic  code,
+                      const char            *format,
+                      va_list                args)
+{
+  DesktopFileMessage *message;
+  gsize               len;
+
+  message = g_slice_new (DesktopFileMessage);
+  message->severity = severity;
+  message->code     = code;
+  message->group    = g_strdup (kf->context_group);
+  message->key      = g_strdup (kf->context_key);
+  message->message  = g_strdup_vprintf (format, args);
+
+  len = strlen (message->message);
+  if (len > 0 && message->message[len - 1] == '\n')
+    message->message[len - 1] = '\0';
+
+  g_ptr_array_add (kf->messages, message);
+}
+
+G_GNUC_PRINTF (3, 4) static void
+print_fatal (kf_validator          *kf,
+             DesktopFileDiagnostic  code,
+             const char            *format, ...)
 {
   va_list args;
-  gchar *str;
 
   g_return_if_fail (kf != NULL && format != NULL);
 
   kf->fatal_error = TRUE;
 
   va_start (args, format);
-  str = g_strdup_vprintf (format, args);
+  validate_add_message (kf, DESKTOP_FILE_SEVERITY_ERROR, code, format, args);
   va_end (args);
-
-  g_print ("%s%s%s: %serror%s: %s",
-           FILENAME_COLOR, kf->filename, RESET_COLOR,
-           FATAL_COLOR, RESET_COLOR, str);
-
-  g_free (str);
 }
 
-G_GNUC_PRINTF (2, 3) static void
-print_future_fatal (kf_validator *kf, const char *format, ...)
+G_GNUC_PRINTF (3, 4) static void
+print_future_fatal (kf_validator          *kf,
+                    DesktopFileDiagnostic  code,
+                    const char            *format, ...)
 {
   va_list args;
-  gchar *str;
 
   g_return_if_fail (kf != NULL && format != NULL);
 
   va_start (args, format);
-  str = g_strdup_vprintf (format, args);
+  validate_add_message (kf, DESKTOP_FILE_SEVERITY_FUTURE_ERROR, code,
+                        format, args);
   va_end (args);
-
-  g_print ("%s%s%s: %serror%s: (will be fatal in the future): %s",
-           FILENAME_COLOR, kf->filename, RESET_COLOR,
-           FUTURE_FATAL_COLOR, RESET_COLOR, str);
-
-  g_free (str);
 }
 
-G_GNUC_PRINTF (2, 3) static void
-print_warning (kf_validator *kf, const char *format, ...)
+G_GNUC_PRINTF (3, 4) static void
+print_warning (kf_validator          *kf,
+               DesktopFileDiagnostic  code,
+               const char            *format, ...)
 {
   va_list args;
-  gchar *str;
 
   g_return_if_fail (kf != NULL && format != NULL);
 
   va_start (args, format);
-  str = g_strdup_vprintf (format, args);
+  validate_add_message (kf, DESKTOP_FILE_SEVERITY_WARNING, code, format, args);
   va_end (args);
-
-  g_print ("%s%s%s: %swarning%s: %s",
-           FILENAME_COLOR, kf->filename, RESET_COLOR,
-           WARNING_COLOR, RESET_COLOR, str);
-
-  g_free (str);
 }
 
-G_GNUC_PRINTF (2, 3) static void
-print_hint (kf_validator *kf, const char *format, ...)
+G_GNUC_PRINTF (3, 4) static void
+print_hint (kf_validator          *kf,
+            DesktopFileDiagnostic  code,
+            const char            *format, ...)
 {
   va_list args;
-  gchar *str;
 
   g_return_if_fail (kf != NULL && format != NULL);
 
@@ -653,14 +876,8 @@ print_hint (kf_validator *kf, const char *format, ...)
     return;
 
   va_start (args, format);
-  str = g_strdup_vprintf (format, args);
+  validate_add_message (kf, DESKTOP_FILE_SEVERITY_HINT, code, format, args);
   va_end (args);
-
-  g_print ("%s%s%s: %shint%s: %s",
-           FILENAME_COLOR, kf->filename, RESET_COLOR,
-           HINT_COLOR, RESET_COLOR, str);
-
-  g_free (str);
 }
 
 /* + Key names must contain only the characters A-Za-z0-9-.
@@ -705,10 +922,11 @@ validate_string_key (kf_validator *kf,
   }
 
   if (error) {
-    print_fatal (kf, "value \"%s\" for string key \"%s\" in group \"%s\" "
-                     "contains invalid characters, string values may contain "
-                     "all ASCII characters except for control characters\n",
-                     value, key, kf->current_group);
+    print_fatal (kf, DIAG_INVALID_STRING_VALUE,
+                 "value \"%s\" for string key \"%s\" in group \"%s\" "
+                 "contains invalid characters, string values may contain "
+                 "all ASCII characters except for control characters\n",
+                 value, key, kf->current_group);
 
     return FALSE;
   }
@@ -737,19 +955,21 @@ validate_localestring_key (kf_validator *kf,
     locale_key = g_strdup_printf ("%s", key);
 
   if (!g_utf8_validate (value, -1, NULL)) {
-    print_fatal (kf, "value \"%s\" for locale string key \"%s\" in group "
-                     "\"%s\" contains invalid UTF-8 characters, locale string "
-                     "values should be encoded in UTF-8\n",
-                     value, locale_key, kf->current_group);
+    print_fatal (kf, DIAG_INVALID_LOCALESTRING_VALUE,
+                 "value \"%s\" for locale string key \"%s\" in group "
+                 "\"%s\" contains invalid UTF-8 characters, locale string "
+                 "values should be encoded in UTF-8\n",
+                 value, locale_key, kf->current_group);
     g_free (locale_key);
 
     return FALSE;
   }
 
   if (!g_hash_table_lookup (kf->current_keys, key)) {
-    print_fatal (kf, "key \"%s\" in group \"%s\" is a localized key, but "
-                     "there is no non-localized key \"%s\"\n",
-                     locale_key, kf->current_group, key);
+    print_fatal (kf, DIAG_MISSING_UNLOCALIZED_KEY,
+                 "key \"%s\" in group \"%s\" is a localized key, but "
+                 "there is no non-localized key \"%s\"\n",
+                 locale_key, kf->current_group, key);
     g_free (locale_key);
 
     return FALSE;
@@ -777,19 +997,21 @@ validate_boolean_key (kf_validator *kf,
 {
   if (strcmp (value, "true") && strcmp (value, "false") &&
       strcmp (value, "0")    && strcmp (value, "1")) {
-    print_fatal (kf, "value \"%s\" for boolean key \"%s\" in group \"%s\" "
-                     "contains invalid characters, boolean values must be "
-                     "\"false\" or \"true\"\n",
-                     value, key, kf->current_group);
+    print_fatal (kf, DIAG_INVALID_BOOLEAN_VALUE,
+                 "value \"%s\" for boolean key \"%s\" in group \"%s\" "
+                 "contains invalid characters, boolean values must be "
+                 "\"false\" or \"true\"\n",
+                 value, key, kf->current_group);
     return FALSE;
   }
 
   if (!kf->no_deprecated_warnings &&
       (!strcmp (value, "0") || !strcmp (value, "1")))
-    print_warning (kf, "boolean key \"%s\" in group \"%s\" has value \"%s\", "
-                       "which is deprecated: boolean values should be "
-                       "\"false\" or \"true\"\n",
-                       key, kf->current_group, value);
+    print_warning (kf, DIAG_DEPRECATED_BOOLEAN_VALUE,
+                   "boolean key \"%s\" in group \"%s\" has value \"%s\", "
+                   "which is deprecated: boolean values should be "
+                   "\"false\" or \"true\"\n",
+                   key, kf->current_group, value);
 
   return TRUE;
 }
@@ -809,10 +1031,11 @@ validate_numeric_key (kf_validator *kf,
 
   res = sscanf (value, "%f", &d);
   if (res == 0) {
-    print_fatal (kf, "value \"%s\" for numeric key \"%s\" in group \"%s\" "
-                     "contains invalid characters, numeric values must be "
-                     "valid floating point numbers\n",
-                     value, key, kf->current_group);
+    print_fatal (kf, DIAG_INVALID_NUMERIC_VALUE,
+                 "value \"%s\" for numeric key \"%s\" in group \"%s\" "
+                 "contains invalid characters, numeric values must be "
+                 "valid floating point numbers\n",
+                 value, key, kf->current_group);
     return FALSE;
   }
 
@@ -844,11 +1067,12 @@ validate_string_regexp_list_key (kf_validator *kf,
   }
 
   if (error) {
-    print_fatal (kf, "value \"%s\" for %s list key \"%s\" in group \"%s\" "
-                     "contains invalid character '%c', %s list values may "
-                     "contain all ASCII characters except for control "
-                     "characters\n",
-                     value, type, key, kf->current_group, value[i], type);
+    print_fatal (kf, DIAG_INVALID_LIST_VALUE,
+                 "value \"%s\" for %s list key \"%s\" in group \"%s\" "
+                 "contains invalid character '%c', %s list values may "
+                 "contain all ASCII characters except for control "
+                 "characters\n",
+                 value, type, key, kf->current_group, value[i], type);
 
     return FALSE;
   }
@@ -898,19 +1122,21 @@ validate_localestring_list_key (kf_validator *kf,
 
 
   if (!g_utf8_validate (value, -1, NULL)) {
-    print_fatal (kf, "value \"%s\" for locale string list key \"%s\" in group "
-                     "\"%s\" contains invalid UTF-8 characters, locale string "
-                     "list values should be encoded in UTF-8\n",
-                     value, locale_key, kf->current_group);
+    print_fatal (kf, DIAG_INVALID_LOCALESTRING_LIST_VALUE,
+                 "value \"%s\" for locale string list key \"%s\" in group "
+                 "\"%s\" contains invalid UTF-8 characters, locale string "
+                 "list values should be encoded in UTF-8\n",
+                 value, locale_key, kf->current_group);
     g_free (locale_key);
 
     return FALSE;
   }
 
   if (!g_hash_table_lookup (kf->current_keys, key)) {
-    print_fatal (kf, "key \"%s\" in group \"%s\" is a localized key, but "
-                     "there is no non-localized key \"%s\"\n",
-                     locale_key, kf->current_group, key);
+    print_fatal (kf, DIAG_MISSING_UNLOCALIZED_KEY,
+                 "key \"%s\" in group \"%s\" is a localized key, but "
+                 "there is no non-localized key \"%s\"\n",
+                 locale_key, kf->current_group, key);
     g_free (locale_key);
 
     return FALSE;
@@ -945,22 +1171,25 @@ handle_type_key (kf_validator *kf,
     /* force the type, since the key might be present multiple times... */
     kf->type = INVALID_TYPE;
 
-    print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                     "is not a registered type value (\"Application\", "
-                     "\"Link\" and \"Directory\")\n",
-                     value, locale_key, kf->current_group);
+    print_fatal (kf, DIAG_UNREGISTERED_TYPE,
+                 "value \"%s\" for key \"%s\" in group \"%s\" "
+                 "is not a registered type value (\"Application\", "
+                 "\"Link\" and \"Directory\")\n",
+                 value, locale_key, kf->current_group);
     return FALSE;
   }
 
   if (registered_types[i].kde_reserved && kf->kde_reserved_warnings)
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "is a reserved value for KDE\n",
-                       value, locale_key, kf->current_group);
+    print_warning (kf, DIAG_KDE_RESERVED_TYPE,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "is a reserved value for KDE\n",
+                   value, locale_key, kf->current_group);
 
   if (registered_types[i].deprecated && !kf->no_deprecated_warnings)
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "is deprecated\n",
-                       value, locale_key, kf->current_group);
+    print_warning (kf, DIAG_DEPRECATED_TYPE,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "is deprecated\n",
+                   value, locale_key, kf->current_group);
 
   kf->type = registered_types[i].type;
   kf->type_string = registered_types[i].name;
@@ -1005,9 +1234,10 @@ handle_version_key (kf_validator *kf,
       return TRUE;
   }
 
-  print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                   "is not a known version\n",
-                   value, locale_key, kf->current_group);
+  print_fatal (kf, DIAG_UNKNOWN_VERSION,
+               "value \"%s\" for key \"%s\" in group \"%s\" "
+               "is not a known version\n",
+               value, locale_key, kf->current_group);
   return FALSE;
 }
 
@@ -1029,10 +1259,11 @@ handle_comment_key (kf_validator *kf,
   g_free (locale_compare_key);
 
   if (keyvalue && g_ascii_strcasecmp (value, keyvalue->value) == 0) {
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "looks the same as that of key \"%s\"\n",
-                       value, locale_key, kf->current_group,
-                       keyvalue->key);
+    print_warning (kf, DIAG_COMMENT_SAME_AS_NAME,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "looks the same as that of key \"%s\"\n",
+                   value, locale_key, kf->current_group,
+                   keyvalue->key);
     return FALSE;
   }
 
@@ -1042,10 +1273,11 @@ handle_comment_key (kf_validator *kf,
   g_free (locale_compare_key);
 
   if (keyvalue && g_ascii_strcasecmp (value, keyvalue->value) == 0) {
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "looks the same as that of key \"%s\"\n",
-                       value, locale_key, kf->current_group,
-                       keyvalue->key);
+    print_warning (kf, DIAG_COMMENT_SAME_AS_NAME,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "looks the same as that of key \"%s\"\n",
+                   value, locale_key, kf->current_group,
+                   keyvalue->key);
     return FALSE;
   }
 
@@ -1067,32 +1299,35 @@ handle_icon_key (kf_validator *kf,
 {
   if (g_path_is_absolute (value)) {
     if (g_str_has_suffix (value, "/")) {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" is an "
-                       "absolute path to a directory, instead of being an "
-                       "absolute path to an icon or an icon name\n",
-                       value, locale_key, kf->current_group);
+      print_fatal (kf, DIAG_ICON_IS_DIRECTORY,
+                   "value \"%s\" for key \"%s\" in group \"%s\" is an "
+                   "absolute path to a directory, instead of being an "
+                   "absolute path to an icon or an icon name\n",
+                   value, locale_key, kf->current_group);
       return FALSE;
     } else
       return TRUE;
   }
 
   if (g_utf8_strchr (value, -1, G_DIR_SEPARATOR)) {
-    print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" looks like "
-                     "a relative path, instead of being an absolute path to "
-                     "an icon or an icon name\n",
-                     value, locale_key, kf->current_group);
+    print_fatal (kf, DIAG_ICON_IS_RELATIVE_PATH,
+                 "value \"%s\" for key \"%s\" in group \"%s\" looks like "
+                 "a relative path, instead of being an absolute path to "
+                 "an icon or an icon name\n",
+                 value, locale_key, kf->current_group);
     return FALSE;
   }
 
   if (g_str_has_suffix (value, ".png") ||
       g_str_has_suffix (value, ".xpm") ||
       g_str_has_suffix (value, ".svg")) {
-    print_future_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" is an "
-                            "icon name with an extension, but there should be "
-                            "no extension as described in the Icon Theme "
-                            "Specification if the value is not an absolute "
-                            "path\n",
-                            value, locale_key, kf->current_group);
+    print_future_fatal (kf, DIAG_ICON_NAME_WITH_EXTENSION,
+                        "value \"%s\" for key \"%s\" in group \"%s\" is an "
+                        "icon name with an extension, but there should be "
+                        "no extension as described in the Icon Theme "
+                        "Specification if the value is not an absolute "
+                        "path\n",
+                        value, locale_key, kf->current_group);
     return FALSE;
   }
 
@@ -1119,14 +1354,14 @@ handle_show_in_key (kf_validator *kf,
   char         **show;
   GHashTable    *hashtable;
   int            i;
-  unsigned int   j;
 
   retval = TRUE;
 
   if (kf->show_in) {
-    print_fatal (kf, "only one of \"OnlyShowIn\" and \"NotShowIn\" keys "
-                     "may appear in group \"%s\"\n",
-                     kf->current_group);
+    print_fatal (kf, DIAG_BOTH_ONLY_SHOW_IN_AND_NOT_SHOW_IN,
+                 "only one of \"OnlyShowIn\" and \"NotShowIn\" keys "
+                 "may appear in group \"%s\"\n",
+                 kf->current_group);
     retval = FALSE;
   }
   kf->show_in = TRUE;
@@ -1141,9 +1376,10 @@ handle_show_in_key (kf_validator *kf,
       break;
 
     if (g_hash_table_lookup (hashtable, show[i])) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains \"%s\" more than once\n",
-                         value, locale_key, kf->current_group, show[i]);
+      print_warning (kf, DIAG_DUPLICATE_SHOW_IN_VALUE,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains \"%s\" more than once\n",
+                     value, locale_key, kf->current_group, show[i]);
       continue;
     }
 
@@ -1152,16 +1388,12 @@ handle_show_in_key (kf_validator *kf,
     if (!strncmp (show[i], "X-", 2))
       continue;
 
-    for (j = 0; j < G_N_ELEMENTS (show_in_registered); j++) {
-      if (!strcmp (show[i], show_in_registered[j]))
-        break;
-    }
-
-    if (j == G_N_ELEMENTS (show_in_registered)) {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "contains an unregistered value \"%s\"; values "
-                       "extending the format should start with \"X-\"\n",
-                       value, locale_key, kf->current_group, show[i]);
+    if (!is_registered_show_in (show[i])) {
+      print_fatal (kf, DIAG_UNREGISTERED_SHOW_IN_VALUE,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "contains an unregistered value \"%s\"; values "
+                   "extending the format should start with \"X-\"\n",
+                   value, locale_key, kf->current_group, show[i]);
       retval = FALSE;
     }
   }
@@ -1242,9 +1474,10 @@ handle_exec_key (kf_validator *kf,
 
 #define PRINT_INVALID_IF_FLAG                                       \
   if (flag) {                                                       \
-    print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" " \
-                     "contains an invalid field code \"%%%c\"\n",   \
-                     value, locale_key, kf->current_group, *c);     \
+    print_fatal (kf, DIAG_INVALID_FIELD_CODE,                       \
+                 "value \"%s\" for key \"%s\" in group \"%s\" "     \
+                 "contains an invalid field code \"%%%c\"\n",       \
+                 value, locale_key, kf->current_group, *c);         \
     retval = FALSE;                                                 \
     flag = FALSE;                                                   \
     break;                                                          \
@@ -1263,11 +1496,12 @@ handle_exec_key (kf_validator *kf,
           if (!escaped)
             in_quote = TRUE;
           else {
-            print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                             "contains an escaped double quote (\\\\\") "
-                             "outside of a quote, but the double quote is "
-                             "a reserved character\n",
-                             value, locale_key, kf->current_group);
+            print_fatal (kf, DIAG_ESCAPED_QUOTE_OUTSIDE_QUOTE,
+                         "value \"%s\" for key \"%s\" in group \"%s\" "
+                         "contains an escaped double quote (\\\\\") "
+                         "outside of a quote, but the double quote is "
+                         "a reserved character\n",
+                         value, locale_key, kf->current_group);
             retval = FALSE;
           }
         }
@@ -1279,19 +1513,21 @@ handle_exec_key (kf_validator *kf,
         PRINT_INVALID_IF_FLAG;
         if (in_quote) {
           if (!escaped) {
-            print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                             "contains a non-escaped character '%c' in a "
-                             "quote, but it should be escaped with two "
-                             "backslashes (\"\\\\%c\")\n",
-                             value, locale_key, kf->current_group, *c, *c);
+            print_fatal (kf, DIAG_UNESCAPED_CHARACTER_IN_QUOTE,
+                         "value \"%s\" for key \"%s\" in group \"%s\" "
+                         "contains a non-escaped character '%c' in a "
+                         "quote, but it should be escaped with two "
+                         "backslashes (\"\\\\%c\")\n",
+                         value, locale_key, kf->current_group, *c, *c);
             retval = FALSE;
           } else
             escaped = FALSE;
         } else {
-          print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                           "contains a reserved character '%c' outside of a "
-                           "quote\n",
-                           value, locale_key, kf->current_group, *c);
+          print_fatal (kf, DIAG_RESERVED_CHARACTER_OUTSIDE_QUOTE,
+                       "value \"%s\" for key \"%s\" in group \"%s\" "
+                       "contains a reserved character '%c' outside of a "
+                       "quote\n",
+                       value, locale_key, kf->current_group, *c);
           retval = FALSE;
         }
         break;
@@ -1300,9 +1536,10 @@ handle_exec_key (kf_validator *kf,
 
         /* Escape character immediately followed by \0? */
         if (*(c + 1) == '\0') {
-          print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                           "ends in an incomplete escape sequence\n",
-                           value, locale_key, kf->current_group);
+          print_fatal (kf, DIAG_INCOMPLETE_ESCAPE_SEQUENCE,
+                       "value \"%s\" for key \"%s\" in group \"%s\" "
+                       "ends in an incomplete escape sequence\n",
+                       value, locale_key, kf->current_group);
           retval = FALSE;
           break;
         }
@@ -1332,10 +1569,11 @@ handle_exec_key (kf_validator *kf,
       case ')':
         PRINT_INVALID_IF_FLAG;
         if (!in_quote) {
-          print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                           "contains a reserved character '%c' outside of a "
-                           "quote\n",
-                           value, locale_key, kf->current_group, *c);
+          print_fatal (kf, DIAG_RESERVED_CHARACTER_OUTSIDE_QUOTE,
+                       "value \"%s\" for key \"%s\" in group \"%s\" "
+                       "contains a reserved character '%c' outside of a "
+                       "quote\n",
+                       value, locale_key, kf->current_group, *c);
           retval = FALSE;
         }
         break;
@@ -1348,10 +1586,11 @@ handle_exec_key (kf_validator *kf,
       case 'u':
         if (flag) {
           if (file_uri) {
-            print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                             "may contain at most one \"%%f\", \"%%u\", "
-                             "\"%%F\" or \"%%U\" field code\n",
-                             value, locale_key, kf->current_group);
+            print_fatal (kf, DIAG_MULTIPLE_FILE_FIELD_CODES,
+                         "value \"%s\" for key \"%s\" in group \"%s\" "
+                         "may contain at most one \"%%f\", \"%%u\", "
+                         "\"%%F\" or \"%%U\" field code\n",
+                         value, locale_key, kf->current_group);
             retval = FALSE;
           }
 
@@ -1363,10 +1602,11 @@ handle_exec_key (kf_validator *kf,
       case 'U':
         if (flag) {
           if (file_uri) {
-            print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                             "may contain at most one \"%%f\", \"%%u\", "
-                             "\"%%F\" or \"%%U\" field code\n",
-                             value, locale_key, kf->current_group);
+            print_fatal (kf, DIAG_MULTIPLE_FILE_FIELD_CODES,
+                         "value \"%s\" for key \"%s\" in group \"%s\" "
+                         "may contain at most one \"%%f\", \"%%u\", "
+                         "\"%%F\" or \"%%U\" field code\n",
+                         value, locale_key, kf->current_group);
             retval = FALSE;
           }
 
@@ -1388,9 +1628,10 @@ handle_exec_key (kf_validator *kf,
       case 'm':
         if (flag) {
           if (!kf->no_deprecated_warnings)
-            print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                               "contains a deprecated field code \"%%%c\"\n",
-                                value, locale_key, kf->current_group, *c);
+            print_warning (kf, DIAG_DEPRECATED_FIELD_CODE,
+                           "value \"%s\" for key \"%s\" in group \"%s\" "
+                           "contains a deprecated field code \"%%%c\"\n",
+                            value, locale_key, kf->current_group, *c);
           flag = FALSE;
         }
         break;
@@ -1404,16 +1645,18 @@ handle_exec_key (kf_validator *kf,
   }
 
   if (in_quote) {
-    print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" contains a "
-                     "quote which is not closed\n",
-                     value, locale_key, kf->current_group);
+    print_fatal (kf, DIAG_UNCLOSED_QUOTE,
+                 "value \"%s\" for key \"%s\" in group \"%s\" contains a "
+                 "quote which is not closed\n",
+                 value, locale_key, kf->current_group);
     retval = FALSE;
   }
 
   if (flag) {
-    print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" contains a "
-                     "non-complete field code\n",
-                     value, locale_key, kf->current_group);
+    print_fatal (kf, DIAG_INCOMPLETE_FIELD_CODE,
+                 "value \"%s\" for key \"%s\" in group \"%s\" contains a "
+                 "non-complete field code\n",
+                 value, locale_key, kf->current_group);
     retval = FALSE;
   }
 
@@ -1445,9 +1688,10 @@ handle_path_key (kf_validator *kf,
   handle_key_for_application (kf, locale_key, value);
 
   if (!g_path_is_absolute (value))
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "does not look like an absolute path\n",
-                       value, locale_key, kf->current_group);
+    print_warning (kf, DIAG_NOT_AN_ABSOLUTE_PATH,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "does not look like an absolute path\n",
+                   value, locale_key, kf->current_group);
 
   return TRUE;
 }
@@ -1461,64 +1705,60 @@ handle_mime_key (kf_validator *kf,
                  const char   *locale_key,
                  const char   *value)
 {
-  gboolean       retval;
-  char         **types;
-  GHashTable    *hashtable;
-  int            i;
-  char          *valid_error;
-  MimeUtilsValidity valid;
+  gboolean         retval;
+  MimeUtilsResult *results;
+  guint            n_results;
+  GHashTable      *hashtable;
+  guint            i;
 
   handle_key_for_application (kf, locale_key, value);
 
   retval = TRUE;
 
-  hashtable = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, NULL);
-  types = g_strsplit (value, ";", 0);
+  /* the mime types of the results are interned */
+  hashtable = g_hash_table_new (NULL, NULL);
+  results = mu_mime_type_list_validate (value, &n_results);
 
-  for (i = 0; types[i]; i++) {
-    /* since the value ends with a semicolon, we'll have an empty string
-     * at the end */
-    if (*types[i] == '\0' && types[i + 1] == NULL)
-      break;
+  for (i = 0; i < n_results; i++) {
+    const char *type = results[i].mime_type;
 
-    if (g_hash_table_lookup (hashtable, types[i])) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains \"%s\" more than once\n",
-                         value, locale_key, kf->current_group, types[i]);
+    if (g_hash_table_contains (hashtable, type)) {
+      print_warning (kf, DIAG_DUPLICATE_MIME_TYPE,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains \"%s\" more than once\n",
+                     value, locale_key, kf->current_group, type);
       continue;
     }
 
-    g_hash_table_insert (hashtable, types[i], types[i]);
+    g_hash_table_add (hashtable, (gpointer) type);
 
-    valid = mu_mime_type_is_valid (types[i], &valid_error);
-    switch (valid) {
+    switch (results[i].validity) {
       case MU_VALID:
         break;
       case MU_DISCOURAGED:
-        print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                           "contains value \"%s\" which is a MIME type that "
-                           "should probably not be used: %s\n",
-                           value, locale_key, kf->current_group,
-                           types[i], valid_error);
-
-        g_free (valid_error);
+        print_warning (kf, DIAG_DISCOURAGED_MIME_TYPE,
+                       "value \"%s\" for key \"%s\" in group \"%s\" "
+                       "contains value \"%s\" which is a MIME type that "
+                       "should probably not be used: %s\n",
+                       value, locale_key, kf->current_group,
+                       type, results[i].error);
         break;
       case MU_INVALID:
-        print_future_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                                "contains value \"%s\" which is an invalid "
-                                "MIME type: %s\n",
-                                value, locale_key, kf->current_group,
-                                types[i], valid_error);
+        print_future_fatal (kf, DIAG_INVALID_MIME_TYPE,
+                            "value \"%s\" for key \"%s\" in group \"%s\" "
+                            "contains value \"%s\" which is an invalid "
+                            "MIME type: %s\n",
+                            value, locale_key, kf->current_group,
+                            type, results[i].error);
 
         retval = FALSE;
-        g_free (valid_error);
         break;
       default:
         g_assert_not_reached ();
     }
   }
 
-  g_strfreev (types);
+  g_free (results);
   g_hash_table_destroy (hashtable);
 
   return retval;
@@ -1563,7 +1803,7 @@ handle_categories_key (kf_validator *kf,
   char         **categories;
   GHashTable    *hashtable;
   int            i;
-  unsigned int   j;
+  int            j;
   int            main_categories_nb;
 
   handle_key_for_application (kf, locale_key, value);
@@ -1588,9 +1828,10 @@ handle_categories_key (kf_validator *kf,
       break;
 
     if (g_hash_table_lookup (hashtable, categories[i])) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains \"%s\" more than once\n",
-                         value, locale_key, kf->current_group, categories[i]);
+      print_warning (kf, DIAG_DUPLICATE_CATEGORY,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains \"%s\" more than once\n",
+                     value, locale_key, kf->current_group, categories[i]);
       continue;
     }
 
@@ -1611,16 +1852,13 @@ handle_categories_key (kf_validator *kf,
     if (!strncmp (categories[i], "X-", 2))
       continue;
 
-    for (j = 0; j < G_N_ELEMENTS (registered_categories); j++) {
-      if (!strcmp (categories[i], registered_categories[j].name))
-        break;
-    }
-
-    if (j == G_N_ELEMENTS (registered_categories)) {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "contains an unregistered value \"%s\"; values "
-                       "extending the format should start with \"X-\"\n",
-                       value, locale_key, kf->current_group, categories[i]);
+    j = lookup_registered_category (categories[i]);
+    if (j < 0) {
+      print_fatal (kf, DIAG_UNREGISTERED_CATEGORY,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "contains an unregistered value \"%s\"; values "
+                   "extending the format should start with \"X-\"\n",
+                   value, locale_key, kf->current_group, categories[i]);
       retval = FALSE;
       continue;
     }
@@ -1638,21 +1876,14 @@ handle_categories_key (kf_validator *kf,
                                           ";", 0);
 
         for (l = 0; required_categories[l]; l++) {
-          unsigned int m;
+          int m;
 
           if (!g_hash_table_lookup (hashtable, required_categories[l]))
             continue;
 
-          for (m = 0; m < G_N_ELEMENTS (registered_categories); m++) {
-            if (strcmp (required_categories[l],
-                        registered_categories[m].name) != 0)
-              continue;
-
-            if (registered_categories[m].main)
-              required_main_category_present = TRUE;
-
-            break;
-          }
+          m = lookup_registered_category (required_categories[l]);
+          if (m >= 0 && registered_categories[m].main)
+            required_main_category_present = TRUE;
 
           if (required_main_category_present)
             break;
@@ -1671,26 +1902,29 @@ handle_categories_key (kf_validator *kf,
     }
 
     if (registered_categories[j].main && main_categories_nb > 1)
-      print_hint (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                      "contains more than one main category; application "
-                      "might appear more than once in the application menu\n",
-                      value, locale_key, kf->current_group);
+      print_hint (kf, DIAG_MULTIPLE_MAIN_CATEGORIES,
+                  "value \"%s\" for key \"%s\" in group \"%s\" "
+                  "contains more than one main category; application "
+                  "might appear more than once in the application menu\n",
+                  value, locale_key, kf->current_group);
 
 
     if (registered_categories[j].deprecated) {
       if (!kf->no_deprecated_warnings)
-        print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                           "contains a deprecated value \"%s\"\n",
-                            value, locale_key, kf->current_group,
-                            categories[i]);
+        print_warning (kf, DIAG_DEPRECATED_CATEGORY,
+                       "value \"%s\" for key \"%s\" in group \"%s\" "
+                       "contains a deprecated value \"%s\"\n",
+                        value, locale_key, kf->current_group,
+                        categories[i]);
     }
 
     if (registered_categories[j].require_only_show_in) {
       if (!g_hash_table_lookup (kf->current_keys, "OnlyShowIn")) {
-        print_fatal (kf, "value item \"%s\" in key \"%s\" in group \"%s\" "
-                         "is a reserved category, so a \"OnlyShowIn\" key "
-                         "must be included\n",
-                         categories[i], locale_key, kf->current_group);
+        print_fatal (kf, DIAG_RESERVED_CATEGORY_WITHOUT_ONLY_SHOW_IN,
+                     "value item \"%s\" in key \"%s\" in group \"%s\" "
+                     "is a reserved category, so a \"OnlyShowIn\" key "
+                     "must be included\n",
+                     categories[i], locale_key, kf->current_group);
         retval = FALSE;
       }
     }
@@ -1730,11 +1964,12 @@ handle_categories_key (kf_validator *kf,
         g_string_append_printf (output_required, ", or %s",
                                 registered_categories[j].requires[k]);
 
-      print_future_fatal (kf, "value item \"%s\" in key \"%s\" in group \"%s\" "
-                              "requires another category to be present among "
-                              "the following categories: %s\n",
-                              categories[i], locale_key, kf->current_group,
-                              output_required->str);
+      print_future_fatal (kf, DIAG_MISSING_RELATED_CATEGORY,
+                          "value item \"%s\" in key \"%s\" in group \"%s\" "
+                          "requires another category to be present among "
+                          "the following categories: %s\n",
+                          categories[i], locale_key, kf->current_group,
+                          output_required->str);
 
       g_string_free (output_required, TRUE);
       retval = FALSE;
@@ -1775,11 +2010,12 @@ handle_categories_key (kf_validator *kf,
         g_string_append_printf (output_suggested, ", or %s",
                                 registered_categories[j].suggests[k]);
 
-      print_hint (kf, "value item \"%s\" in key \"%s\" in group \"%s\" "
-                      "can be extended with another category among the "
-                      "following categories: %s\n",
-                      categories[i], locale_key, kf->current_group,
-                      output_suggested->str);
+      print_hint (kf, DIAG_CATEGORY_CAN_BE_EXTENDED,
+                  "value item \"%s\" in key \"%s\" in group \"%s\" "
+                  "can be extended with another category among the "
+                  "following categories: %s\n",
+                  categories[i], locale_key, kf->current_group,
+                  output_suggested->str);
 
       g_string_free (output_suggested, TRUE);
     }
@@ -1792,11 +2028,12 @@ handle_categories_key (kf_validator *kf,
   g_assert (main_categories_nb >= 0);
 
   if (main_categories_nb == 0)
-    print_hint (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                    "does not contain a registered main category; application "
-                    "might only show up in a \"catch-all\" section of the "
-                    "application menu\n",
-                    value, locale_key, kf->current_group);
+    print_hint (kf, DIAG_NO_MAIN_CATEGORY,
+                "value \"%s\" for key \"%s\" in group \"%s\" "
+                "does not contain a registered main category; application "
+                "might only show up in a \"catch-all\" section of the "
+                "application menu\n",
+                value, locale_key, kf->current_group);
 
   return retval;
 }
@@ -1842,9 +2079,10 @@ handle_keywords_key (kf_validator *kf,
      * at the end */
     if (*keywords[i] == '\0') {
       if (keywords[i + 1] != NULL) {
-        print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains an empty keyword\n",
-                         value, locale_key, kf->current_group);
+        print_fatal (kf, DIAG_EMPTY_KEYWORD,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains an empty keyword\n",
+                     value, locale_key, kf->current_group);
         retval = FALSE;
         break;
       }
@@ -1854,21 +2092,23 @@ handle_keywords_key (kf_validator *kf,
 
     if (keyvalue_name &&
         g_ascii_strcasecmp (keywords[i], keyvalue_name->value) == 0) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains keyword \"%s\" which is the same as the "
-                         "value of key \"%s\"\n",
-                         value, locale_key, kf->current_group,
-                         keywords[i], keyvalue_name->key);
+      print_warning (kf, DIAG_KEYWORD_SAME_AS_NAME,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains keyword \"%s\" which is the same as the "
+                     "value of key \"%s\"\n",
+                     value, locale_key, kf->current_group,
+                     keywords[i], keyvalue_name->key);
       retval = FALSE;
     }
 
     if (keyvalue_genericname &&
         g_ascii_strcasecmp (keywords[i], keyvalue_genericname->value) == 0) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains keyword \"%s\" which is the same as the "
-                         "value of key \"%s\"\n",
-                         value, locale_key, kf->current_group,
-                         keywords[i], keyvalue_genericname->key);
+      print_warning (kf, DIAG_KEYWORD_SAME_AS_NAME,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains keyword \"%s\" which is the same as the "
+                     "value of key \"%s\"\n",
+                     value, locale_key, kf->current_group,
+                     keywords[i], keyvalue_genericname->key);
       retval = FALSE;
     }
   }
@@ -1904,9 +2144,10 @@ handle_actions_key (kf_validator *kf,
      * at the end */
     if (*actions[i] == '\0') {
       if (actions[i + 1] != NULL) {
-        print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains an empty action\n",
-                         value, locale_key, kf->current_group);
+        print_fatal (kf, DIAG_EMPTY_ACTION,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains an empty action\n",
+                     value, locale_key, kf->current_group);
         retval = FALSE;
         break;
       }
@@ -1915,17 +2156,19 @@ handle_actions_key (kf_validator *kf,
     }
 
     if (g_hash_table_lookup (kf->action_values, actions[i])) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains action \"%s\" more than once\n",
-                         value, locale_key, kf->current_group, actions[i]);
+      print_warning (kf, DIAG_DUPLICATE_ACTION,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains action \"%s\" more than once\n",
+                     value, locale_key, kf->current_group, actions[i]);
       continue;
     }
 
     if (!key_is_valid (actions[i], strlen (actions[i]))) {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "contains invalid action identifier \"%s\", only "
-                       "alphanumeric characters and '-' are allowed\n",
-                       value, locale_key, kf->current_group, actions[i]);
+      print_fatal (kf, DIAG_INVALID_ACTION_IDENTIFIER,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "contains invalid action identifier \"%s\", only "
+                   "alphanumeric characters and '-' are allowed\n",
+                   value, locale_key, kf->current_group, actions[i]);
       retval = FALSE;
       break;
     }
@@ -1960,17 +2203,19 @@ handle_implements_key (kf_validator *kf,
 
   for (i = 0; interfaces[i]; i++) {
     if (!g_dbus_is_interface_name (interfaces[i])) {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "contains an invalid interface name \"%s\"\n",
-                       value, locale_key, kf->current_group, interfaces[i]);
+      print_fatal (kf, DIAG_INVALID_INTERFACE_NAME,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "contains an invalid interface name \"%s\"\n",
+                   value, locale_key, kf->current_group, interfaces[i]);
       retval = FALSE;
       break;
     }
 
     if (g_hash_table_lookup (kf->interfaces, interfaces[i])) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains interface \"%s\" more than once\n",
-                         value, locale_key, kf->current_group, interfaces[i]);
+      print_warning (kf, DIAG_DUPLICATE_INTERFACE,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains interface \"%s\" more than once\n",
+                     value, locale_key, kf->current_group, interfaces[i]);
       continue;
     }
 
@@ -2016,7 +2261,8 @@ handle_dbus_activatable_key (kf_validator *kf,
 
 out:
   if (!p) {
-    print_fatal (kf, "DBusActivatable filename must conform to reverse-DNS notation\n");
+    print_fatal (kf, DIAG_DBUS_FILENAME_NOT_REVERSE_DNS,
+                 "DBusActivatable filename must conform to reverse-DNS notation\n");
     retval = FALSE;
   }
 
@@ -2036,9 +2282,10 @@ handle_dev_key (kf_validator *kf,
   handle_key_for_fsdevice (kf, locale_key, value);
 
   if (!g_path_is_absolute (value))
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "does not look like an absolute path\n",
-                       value, locale_key, kf->current_group);
+    print_warning (kf, DIAG_NOT_AN_ABSOLUTE_PATH,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "does not look like an absolute path\n",
+                   value, locale_key, kf->current_group);
 
   return TRUE;
 }
@@ -2055,9 +2302,10 @@ handle_mountpoint_key (kf_validator *kf,
   handle_key_for_fsdevice (kf, locale_key, value);
 
   if (!g_path_is_absolute (value))
-    print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "does not look like an absolute path\n",
-                       value, locale_key, kf->current_group);
+    print_warning (kf, DIAG_NOT_AN_ABSOLUTE_PATH,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "does not look like an absolute path\n",
+                   value, locale_key, kf->current_group);
 
   return TRUE;
 }
@@ -2073,10 +2321,11 @@ handle_encoding_key (kf_validator *kf,
   if (!strcmp (value, "UTF-8") || !strcmp (value, "Legacy-Mixed"))
     return TRUE;
 
-  print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                   "is not a registered encoding value (\"UTF-8\", and "
-                   "\"Legacy-Mixed\")\n",
-                   value, locale_key, kf->current_group);
+  print_fatal (kf, DIAG_UNREGISTERED_ENCODING,
+               "value \"%s\" for key \"%s\" in group \"%s\" "
+               "is not a registered encoding value (\"UTF-8\", and "
+               "\"Legacy-Mixed\")\n",
+               value, locale_key, kf->current_group);
 
   return FALSE;
 }
@@ -2125,16 +2374,18 @@ handle_autostart_condition_key (kf_validator *kf,
 
   if (!strcmp (condition, "if-exists") || !strcmp (condition, "unless-exists")) {
     if (!argument || argument[0] == '\0') {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "does not contain a path to a file to test the "
-                       "condition\n",
-                       value, locale_key, kf->current_group);
+      print_fatal (kf, DIAG_CONDITION_WITHOUT_PATH,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "does not contain a path to a file to test the "
+                   "condition\n",
+                   value, locale_key, kf->current_group);
       retval = FALSE;
     } else if (argument[0] == G_DIR_SEPARATOR) {
-      print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                       "contains a path \"%s\" that is absolute, while it "
-                       "should be relative (to $XDG_CONFIG_HOME)\n",
-                       value, locale_key, kf->current_group, argument);
+      print_fatal (kf, DIAG_CONDITION_WITH_ABSOLUTE_PATH,
+                   "value \"%s\" for key \"%s\" in group \"%s\" "
+                   "contains a path \"%s\" that is absolute, while it "
+                   "should be relative (to $XDG_CONFIG_HOME)\n",
+                   value, locale_key, kf->current_group, argument);
       retval = FALSE;
     } else if (argument[0] == '.' &&
                ((strlen (argument) == 2 &&
@@ -2142,17 +2393,19 @@ handle_autostart_condition_key (kf_validator *kf,
                 (strlen (argument) >= 3 &&
                  argument[1] == '.' &&
                  argument[2] == G_DIR_SEPARATOR))) {
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains a path \"%s\" that depends on the value "
-                         "of $XDG_CONFIG_HOME (\"..\" should be avoided)\n",
-                         value, locale_key, kf->current_group, argument);
+      print_warning (kf, DIAG_CONDITION_WITH_PARENT_PATH,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains a path \"%s\" that depends on the value "
+                     "of $XDG_CONFIG_HOME (\"..\" should be avoided)\n",
+                     value, locale_key, kf->current_group, argument);
     }
 
   } else if (strncmp (condition, "X-", 2) == 0) {
     if (argument && argument[0] == '\0')
-      print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "has trailing space(s)\n",
-                         value, locale_key, kf->current_group);
+      print_warning (kf, DIAG_CONDITION_TRAILING_SPACE,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "has trailing space(s)\n",
+                     value, locale_key, kf->current_group);
   } else {
     unsigned int i;
     unsigned int j;
@@ -2192,11 +2445,12 @@ handle_autostart_condition_key (kf_validator *kf,
           g_string_append_printf (output, ", or %s",
                                   registered_autostart_condition[i].first_arg[j]);
 
-        print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "does not contain a valid first argument for "
-                         "condition \"%s\"; valid first arguments are: %s\n",
-                         value, locale_key, kf->current_group,
-                         condition, output->str);
+        print_fatal (kf, DIAG_CONDITION_INVALID_FIRST_ARGUMENT,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "does not contain a valid first argument for "
+                     "condition \"%s\"; valid first arguments are: %s\n",
+                     value, locale_key, kf->current_group,
+                     condition, output->str);
         retval = FALSE;
 
         g_string_free (output, TRUE);
@@ -2206,9 +2460,10 @@ handle_autostart_condition_key (kf_validator *kf,
         switch (registered_autostart_condition[i].additional_args) {
           case 0:
             if (argument && argument[0] != '\0') {
-              print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                               "has too many arguments for condition \"%s\"\n",
-                               value, locale_key, kf->current_group, condition);
+              print_fatal (kf, DIAG_CONDITION_TOO_MANY_ARGUMENTS,
+                           "value \"%s\" for key \"%s\" in group \"%s\" "
+                           "has too many arguments for condition \"%s\"\n",
+                           value, locale_key, kf->current_group, condition);
               retval = FALSE;
             }
             break;
@@ -2218,10 +2473,11 @@ handle_autostart_condition_key (kf_validator *kf,
              * normal there, and therefore we don't want to split the string
              * based on spaces */
             if (!argument || argument[0] == '\0') {
-              print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                               "is missing a last argument for condition "
-                               "\"%s\"\n",
-                               value, locale_key, kf->current_group, condition);
+              print_fatal (kf, DIAG_CONDITION_TOO_FEW_ARGUMENTS,
+                           "value \"%s\" for key \"%s\" in group \"%s\" "
+                           "is missing a last argument for condition "
+                           "\"%s\"\n",
+                           value, locale_key, kf->current_group, condition);
               retval = FALSE;
             }
             break;
@@ -2238,18 +2494,20 @@ handle_autostart_condition_key (kf_validator *kf,
               }
 
               if (argc_diff > 0) {
-                print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                                 "has %d too many arguments for condition "
-                                 "\"%s\"\n",
-                                 value, locale_key, kf->current_group,
-                                 argc_diff, condition);
+                print_fatal (kf, DIAG_CONDITION_TOO_MANY_ARGUMENTS,
+                             "value \"%s\" for key \"%s\" in group \"%s\" "
+                             "has %d too many arguments for condition "
+                             "\"%s\"\n",
+                             value, locale_key, kf->current_group,
+                             argc_diff, condition);
                 retval = FALSE;
               } else if (argc_diff < 0) {
-                print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                                 "has %d too few arguments for condition "
-                                 "\"%s\"\n",
-                                 value, locale_key, kf->current_group,
-                                 -argc_diff, condition);
+                print_fatal (kf, DIAG_CONDITION_TOO_FEW_ARGUMENTS,
+                             "value \"%s\" for key \"%s\" in group \"%s\" "
+                             "has %d too few arguments for condition "
+                             "\"%s\"\n",
+                             value, locale_key, kf->current_group,
+                             -argc_diff, condition);
                 retval = FALSE;
               }
             }
@@ -2267,24 +2525,21 @@ handle_autostart_condition_key (kf_validator *kf,
     if (i == G_N_ELEMENTS (registered_autostart_condition)) {
       /* Accept conditions with same name as OnlyShowIn values */
 
-      for (i = 0; i < G_N_ELEMENTS (show_in_registered); i++) {
-        if (!strcmp (condition, show_in_registered[i]))
-          break;
-      }
-
-      if (i == G_N_ELEMENTS (show_in_registered)) {
-        print_fatal (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                         "contains an unregistered value \"%s\" for the "
-                         "condition; values extending the format should "
-                         "start with \"X-\"\n",
-                         value, locale_key, kf->current_group, condition);
+      if (!is_registered_show_in (condition)) {
+        print_fatal (kf, DIAG_UNREGISTERED_CONDITION,
+                     "value \"%s\" for key \"%s\" in group \"%s\" "
+                     "contains an unregistered value \"%s\" for the "
+                     "condition; values extending the format should "
+                     "start with \"X-\"\n",
+                     value, locale_key, kf->current_group, condition);
         retval = FALSE;
       }
 
       if (argument && argument[0] == '\0')
-        print_warning (kf, "value \"%s\" for key \"%s\" in group \"%s\" "
-                           "has trailing space(s)\n",
-                           value, locale_key, kf->current_group);
+        print_warning (kf, DIAG_CONDITION_TRAILING_SPACE,
+                       "value \"%s\" for key \"%s\" in group \"%s\" "
+                       "has trailing space(s)\n",
+                       value, locale_key, kf->current_group);
     }
   }
 
@@ -2402,23 +2657,23 @@ validate_known_key (kf_validator         *kf,
                     const char           *locale,
                     const char           *value,
                     DesktopKeyDefinition *keys,
-                    unsigned int          n_keys)
+                    const PerfectHash    *keys_hash)
 {
-  unsigned int i;
+  int          i;
   unsigned int j;
 
-  for (i = 0; i < n_keys; i++) {
-    if (strcmp (key, keys[i].name))
-      continue;
+  i = perfect_hash_lookup (keys_hash, key);
+  if (i >= 0 && strcmp (key, keys[i].name) == 0) {
 
     if (keys[i].type != DESKTOP_LOCALESTRING_TYPE &&
         keys[i].type != DESKTOP_LOCALESTRING_LIST_TYPE &&
         locale != NULL) {
       if (!strncmp (key, "X-", 2))
         return TRUE;
-      print_fatal (kf, "file contains key \"%s\" in group \"%s\", "
-                       "but \"%s\" is not defined as a locale string\n",
-                       locale_key, kf->current_group, key);
+      print_fatal (kf, DIAG_KEY_NOT_LOCALIZABLE,
+                   "file contains key \"%s\" in group \"%s\", "
+                   "but \"%s\" is not defined as a locale string\n",
+                   locale_key, kf->current_group, key);
       return FALSE;
     }
 
@@ -2430,13 +2685,15 @@ validate_known_key (kf_validator         *kf,
     g_assert (j != G_N_ELEMENTS (validate_for_type));
 
     if (!kf->no_deprecated_warnings && keys[i].deprecated)
-      print_warning (kf, "key \"%s\" in group \"%s\" is deprecated\n",
-                         locale_key, kf->current_group);
+      print_warning (kf, DIAG_DEPRECATED_KEY,
+                     "key \"%s\" in group \"%s\" is deprecated\n",
+                     locale_key, kf->current_group);
 
     if (keys[i].kde_reserved && kf->kde_reserved_warnings)
-      print_warning (kf, "key \"%s\" in group \"%s\" is a reserved key for "
-                         "KDE\n",
-                         locale_key, kf->current_group);
+      print_warning (kf, DIAG_KDE_RESERVED_KEY,
+                     "key \"%s\" in group \"%s\" is a reserved key for "
+                     "KDE\n",
+                     locale_key, kf->current_group);
 
     if (!strncmp (key, "X-", 2))
       return TRUE;
@@ -2448,14 +2705,11 @@ validate_known_key (kf_validator         *kf,
       if (!keys[i].handle_and_validate (kf, locale_key, value))
         return FALSE;
     }
-
-    break;
-  }
-
-  if (i == n_keys && strncmp (key, "X-", 2)) {
-    print_fatal (kf, "file contains key \"%s\" in group \"%s\", but "
-                     "keys extending the format should start with "
-                     "\"X-\"\n", key, kf->current_group);
+  } else if (strncmp (key, "X-", 2)) {
+    print_fatal (kf, DIAG_UNREGISTERED_KEY,
+                 "file contains key \"%s\" in group \"%s\", but "
+                 "keys extending the format should start with "
+                 "\"X-\"\n", key, kf->current_group);
     return FALSE;
   }
 
@@ -2471,7 +2725,7 @@ validate_desktop_key (kf_validator *kf,
 {
   return validate_known_key (kf, locale_key, key, locale, value,
                              registered_desktop_keys,
-                             G_N_ELEMENTS (registered_desktop_keys));
+                             &registered_desktop_keys_hash);
 }
 
 static gboolean
@@ -2483,7 +2737,7 @@ validate_action_key (kf_validator *kf,
 {
   return validate_known_key (kf, locale_key, key, locale, value,
                              registered_action_keys,
-                             G_N_ELEMENTS (registered_action_keys));
+                             &registered_action_keys_hash);
 }
 
 /* + Multiple keys in the same group may not have the same name.
@@ -2539,19 +2793,23 @@ validate_keys_for_current_group (kf_validator *kf)
     }
   }
 
+  kf->context_group = kf->current_group;
+
   for (sl = keys; sl != NULL; sl = sl->next) {
     kf_keyvalue *keyvalue;
     gboolean     skip_desktop_check;
 
     keyvalue = (kf_keyvalue *) sl->data;
+    kf->context_key = keyvalue->key;
 
     skip_desktop_check = FALSE;
 
     if (!key_extract_locale (keyvalue->key, &key, &locale)) {
-        print_fatal (kf, "file contains key \"%s\" in group \"%s\", but "
-                         "key names must contain only the characters "
-                         "A-Za-z0-9- (they may have a \"[LOCALE]\" postfix)\n",
-                         keyvalue->key, kf->current_group);
+        print_fatal (kf, DIAG_INVALID_KEY_NAME,
+                     "file contains key \"%s\" in group \"%s\", but "
+                     "key names must contain only the characters "
+                     "A-Za-z0-9- (they may have a \"[LOCALE]\" postfix)\n",
+                     keyvalue->key, kf->current_group);
         retval = FALSE;
         skip_desktop_check = TRUE;
 
@@ -2563,8 +2821,9 @@ validate_keys_for_current_group (kf_validator *kf)
     hashvalue = g_hash_table_lookup (duplicated_keys_hash, keyvalue->key);
     if (GPOINTER_TO_INT (hashvalue) > 1) {
       g_hash_table_remove (duplicated_keys_hash, keyvalue->key);
-      print_fatal (kf, "file contains multiple keys named \"%s\" in "
-                       "group \"%s\"\n", keyvalue->key, kf->current_group);
+      print_fatal (kf, DIAG_DUPLICATE_KEY,
+                   "file contains multiple keys named \"%s\" in "
+                   "group \"%s\"\n", keyvalue->key, kf->current_group);
       retval = FALSE;
     }
 
@@ -2584,6 +2843,8 @@ validate_keys_for_current_group (kf_validator *kf)
     locale = NULL;
   }
 
+  kf->context_key = NULL;
+
   g_slist_free (keys);
   g_hash_table_destroy (duplicated_keys_hash);
   g_hash_table_destroy (kf->current_keys);
@@ -2623,9 +2884,10 @@ validate_group_name (kf_validator *kf,
   for (i = 0; group[i] != '\0'; i++) {
     c = group[i];
     if (g_ascii_iscntrl (c) || c == '[' || c == ']') {
-      print_fatal (kf, "file contains group \"%s\", but group names "
-                       "may contain all ASCII characters except for [ "
-                       "and ] and control characters\n", group);
+      print_fatal (kf, DIAG_INVALID_GROUP_NAME,
+                   "file contains group \"%s\", but group names "
+                   "may contain all ASCII characters except for [ "
+                   "and ] and control characters\n", group);
       return FALSE;
     }
   }
@@ -2635,9 +2897,10 @@ validate_group_name (kf_validator *kf,
 
   if (!strcmp (group, GROUP_DESKTOP_ENTRY)) {
     if (kf->main_group && !strcmp (kf->main_group, GROUP_KDE_DESKTOP_ENTRY))
-      print_warning (kf, "file contains groups \"%s\" and \"%s\", which play "
-                         "the same role\n",
-                         GROUP_KDE_DESKTOP_ENTRY, GROUP_DESKTOP_ENTRY);
+      print_warning (kf, DIAG_REDUNDANT_GROUPS,
+                     "file contains groups \"%s\" and \"%s\", which play "
+                     "the same role\n",
+                     GROUP_KDE_DESKTOP_ENTRY, GROUP_DESKTOP_ENTRY);
 
     kf->main_group = GROUP_DESKTOP_ENTRY;
 
@@ -2646,13 +2909,15 @@ validate_group_name (kf_validator *kf,
 
   if (!strcmp (group, GROUP_KDE_DESKTOP_ENTRY)) {
     if (kf->kde_reserved_warnings || !kf->no_deprecated_warnings)
-      print_warning (kf, "file contains group \"%s\", which is deprecated "
-                         "in favor of \"%s\"\n", group, GROUP_DESKTOP_ENTRY);
+      print_warning (kf, DIAG_DEPRECATED_GROUP,
+                     "file contains group \"%s\", which is deprecated "
+                     "in favor of \"%s\"\n", group, GROUP_DESKTOP_ENTRY);
 
     if (kf->main_group && !strcmp (kf->main_group, GROUP_DESKTOP_ENTRY))
-      print_warning (kf, "file contains groups \"%s\" and \"%s\", which play "
-                         "the same role\n",
-                         GROUP_DESKTOP_ENTRY, GROUP_KDE_DESKTOP_ENTRY);
+      print_warning (kf, DIAG_REDUNDANT_GROUPS,
+                     "file contains groups \"%s\" and \"%s\", which play "
+                     "the same role\n",
+                     GROUP_DESKTOP_ENTRY, GROUP_KDE_DESKTOP_ENTRY);
 
     kf->main_group = GROUP_KDE_DESKTOP_ENTRY;
 
@@ -2661,8 +2926,9 @@ validate_group_name (kf_validator *kf,
 
   if (!strncmp (group, GROUP_DESKTOP_ACTION, strlen (GROUP_DESKTOP_ACTION))) {
     if (group[strlen (GROUP_DESKTOP_ACTION) - 1] == '\0') {
-      print_fatal (kf, "file contains group \"%s\", which is an action "
-                       "group with no action name\n", group);
+      print_fatal (kf, DIAG_ACTION_GROUP_WITHOUT_NAME,
+                   "file contains group \"%s\", which is an action "
+                   "group with no action name\n", group);
       return FALSE;
     } else {
       char *action;
@@ -2670,9 +2936,10 @@ validate_group_name (kf_validator *kf,
       action = g_strdup (group + strlen (GROUP_DESKTOP_ACTION));
 
       if (!key_is_valid (action, strlen (action))) {
-        print_fatal (kf, "file contains group \"%s\", which has an invalid "
-                         "action identifier, only alphanumeric characters and "
-                         "'-' are allowed\n", group);
+        print_fatal (kf, DIAG_INVALID_ACTION_IDENTIFIER,
+                     "file contains group \"%s\", which has an invalid "
+                     "action identifier, only alphanumeric characters and "
+                     "'-' are allowed\n", group);
         g_free (action);
         return FALSE;
       }
@@ -2686,8 +2953,9 @@ validate_group_name (kf_validator *kf,
   if (g_hash_table_lookup (kf->interfaces, group))
       return TRUE;
 
-  print_fatal (kf, "file contains group \"%s\", but groups extending "
-                   "the format should start with \"X-\"\n", group);
+  print_fatal (kf, DIAG_UNREGISTERED_GROUP,
+               "file contains group \"%s\", but groups extending "
+               "the format should start with \"X-\"\n", group);
   return FALSE;
 }
 
@@ -2705,6 +2973,8 @@ validate_required_keys (kf_validator         *kf,
 
   retval = TRUE;
 
+  kf->context_group = group_name;
+
   hashtable = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, NULL);
   keys = g_hash_table_lookup (kf->groups, group_name);
 
@@ -2719,29 +2989,37 @@ validate_required_keys (kf_validator         *kf,
     if (key_definitions[i].required) {
       if (!g_hash_table_lookup (hashtable,
                                 key_definitions[i].name)) {
-        print_fatal (kf, "required key \"%s\" in group \"%s\" is not "
-                         "present\n",
-                         key_definitions[i].name, group_name);
+        kf->context_key = key_definitions[i].name;
+        print_fatal (kf, DIAG_MISSING_REQUIRED_KEY,
+                     "required key \"%s\" in group \"%s\" is not "
+                     "present\n",
+                     key_definitions[i].name, group_name);
         retval = FALSE;
       }
     }
   }
 
   if (kf->type == APPLICATION_TYPE && !g_hash_table_lookup (hashtable, "Exec")) {
+    kf->context_key = "Exec";
     if (!kf->dbus_activatable) {
-      print_fatal (kf, "key \"Exec\" in group \"%s\" is required if key "
-                       "\"DBusActivatable\" is not set to true in the main "
-                       "desktop entry group.\n",
-                       group_name);
+      print_fatal (kf, DIAG_MISSING_EXEC_KEY,
+                   "key \"Exec\" in group \"%s\" is required if key "
+                   "\"DBusActivatable\" is not set to true in the main "
+                   "desktop entry group.\n",
+                   group_name);
       retval = FALSE;
     } else {
-      print_warning (kf, "key \"Exec\" in group \"%s\" should be specified "
-                         "for compatibility with implementations that do not "
-                         "understand key \"DBusActivatable\".\n",
-                         group_name);
+      print_warning (kf, DIAG_RECOMMENDED_EXEC_KEY,
+                     "key \"Exec\" in group \"%s\" should be specified "
+                     "for compatibility with implementations that do not "
+                     "understand key \"DBusActivatable\".\n",
+                     group_name);
     }
   }
 
+  kf->context_group = NULL;
+  kf->context_key = NULL;
+
   g_hash_table_destroy (hashtable);
 
   return retval;
@@ -2760,9 +3038,13 @@ static void                                                                  \
 print_error_foreach_##lower##_key (const char   *name,                       \
                                    kf_validator *kf)                         \
 {                                                                            \
-  print_fatal (kf, "key \"%s\" is present in group \"%s\", but the type is " \
-                   "\"%s\" while this key is only valid for type \"%s\"\n",  \
-                   name, kf->main_group, kf->type_string, real);             \
+  kf->context_group = kf->main_group;                                        \
+  kf->context_key = name;                                                    \
+  print_fatal (kf, DIAG_KEY_NOT_VALID_FOR_TYPE,                              \
+               "key \"%s\" is present in group \"%s\", but the type is "     \
+               "\"%s\" while this key is only valid for type \"%s\"\n",      \
+               name, kf->main_group, kf->type_string, real);                 \
+  kf->context_key = NULL;                                                    \
 }
 
 PRINT_ERROR_FOREACH_KEY (application, "Application")
@@ -2873,8 +3155,12 @@ print_error_foreach_action (char         *key,
                             char         *value,
                             kf_validator *kf)
 {
-  print_fatal (kf, "action \"%s\" is defined, but there is no matching "
-                   "\"%s%s\" group\n", key, GROUP_DESKTOP_ACTION, key);
+  kf->context_group = kf->main_group;
+  kf->context_key = "Actions";
+  print_fatal (kf, DIAG_ACTION_WITHOUT_GROUP,
+               "action \"%s\" is defined, but there is no matching "
+               "\"%s%s\" group\n", key, GROUP_DESKTOP_ACTION, key);
+  kf->context_key = NULL;
 }
 
 static void
@@ -2882,8 +3168,16 @@ print_error_foreach_group (char         *key,
                            char         *value,
                            kf_validator *kf)
 {
-  print_fatal (kf, "action group \"%s%s\" exists, but there is no matching "
-                   "action \"%s\"\n", GROUP_DESKTOP_ACTION, key, key);
+  char *group;
+
+  group = g_strconcat (GROUP_DESKTOP_ACTION, key, NULL);
+  kf->context_group = group;
+  kf->context_key = NULL;
+  print_fatal (kf, DIAG_ACTION_GROUP_WITHOUT_ACTION,
+               "action group \"%s%s\" exists, but there is no matching "
+               "action \"%s\"\n", GROUP_DESKTOP_ACTION, key, key);
+  kf->context_group = NULL;
+  g_free (group);
 }
 
 static gboolean
@@ -2914,12 +3208,16 @@ validate_actions (kf_validator *kf)
 static gboolean
 validate_filename (kf_validator *kf)
 {
+  kf->context_group = NULL;
+  kf->context_key = NULL;
+
   if (kf->type == DIRECTORY_TYPE) {
     if (g_str_has_suffix (kf->filename, ".directory"))
       return TRUE;
     else {
-      print_fatal (kf, "file is of type \"Directory\", but filename does not "
-                       "have a .directory extension\n");
+      print_fatal (kf, DIAG_INVALID_FILENAME_EXTENSION,
+                   "file is of type \"Directory\", but filename does not "
+                   "have a .directory extension\n");
       return FALSE;
     }
   }
@@ -2929,12 +3227,14 @@ validate_filename (kf_validator *kf)
 
   if (g_str_has_suffix (kf->filename, ".kdelnk")) {
     if (kf->kde_reserved_warnings || !kf->no_deprecated_warnings)
-      print_warning (kf, "filename has a .kdelnk extension, which is "
-                         "deprecated in favor of .desktop\n");
+      print_warning (kf, DIAG_DEPRECATED_FILENAME_EXTENSION,
+                     "filename has a .kdelnk extension, which is "
+                     "deprecated in favor of .desktop\n");
     return TRUE;
   }
 
-  print_fatal (kf, "filename does not have a .desktop extension\n");
+  print_fatal (kf, DIAG_INVALID_FILENAME_EXTENSION,
+               "filename does not have a .desktop extension\n");
   return FALSE;
 }
 
@@ -2943,9 +3243,10 @@ validate_filename (kf_validator *kf)
  */
 static gboolean
 validate_line_is_comment (kf_validator *kf,
-                          const char   *line)
+                          const char   *line,
+                          gsize         len)
 {
-  return (*line == '#' || *line == '\0');
+  return (len == 0 || *line == '#');
 }
 
 /* + A group header with name groupname is a line in the format: [groupname]
@@ -2957,25 +3258,27 @@ validate_line_is_comment (kf_validator *kf,
 static gboolean
 validate_line_looks_like_group (kf_validator  *kf,
                                 const char    *line,
+                                gsize          len,
                                 char         **group)
 {
-  char     *chomped;
-  gboolean  result;
+  gsize    chomped_len;
+  gboolean result;
 
-  chomped = g_strdup (line);
-  g_strchomp (chomped);
+  chomped_len = len;
+  while (chomped_len > 0 && g_ascii_isspace (line[chomped_len - 1]))
+    chomped_len--;
 
-  result = (*chomped == '[' && chomped[strlen (chomped) - 1] == ']');
+  result = (chomped_len > 0 &&
+            line[0] == '[' && line[chomped_len - 1] == ']');
 
-  if (result && strcmp (chomped, line))
-    print_fatal (kf, "line \"%s\" ends with a space, but looks like a group. "
-                     "The validation will continue, with the trailing spaces "
-                     "ignored.\n", line);
+  if (result && chomped_len != len)
+    print_fatal (kf, DIAG_GROUP_TRAILING_SPACE,
+                 "line \"%.*s\" ends with a space, but looks like a group. "
+                 "The validation will continue, with the trailing spaces "
+                 "ignored.\n", (int) len, line);
 
   if (group && result)
-    *group = g_strndup (chomped + 1, strlen (chomped) - 2);
-
-  g_free (chomped);
+    *group = g_strndup (line + 1, chomped_len - 2);
 
   return result;
 }
@@ -2987,18 +3290,19 @@ validate_line_looks_like_group (kf_validator  *kf,
 static gboolean
 validate_line_looks_like_entry (kf_validator  *kf,
                                 const char    *line,
+                                gsize          len,
                                 char         **key,
                                 char         **value)
 {
-  char *p;
+  const char *p;
 
-  p = g_utf8_strchr (line, -1, '=');
+  p = memchr (line, '=', len);
 
   if (!p)
     return FALSE;
 
   /* key must be non-empty */
-  if (*p == line[0])
+  if (p == line)
     return FALSE;
 
   if (key) {
@@ -3006,7 +3310,7 @@ validate_line_looks_like_entry (kf_validator  *kf,
     g_strchomp (*key);
   }
   if (value) {
-    *value = g_strdup (p + 1);
+    *value = g_strndup (p + 1, line + len - (p + 1));
     g_strchug (*value);
   }
 
@@ -3021,48 +3325,61 @@ validate_line_looks_like_entry (kf_validator  *kf,
  *   Checked.
  */
 static void
-validate_parse_line (kf_validator *kf)
+validate_parse_line (kf_validator *kf,
+                     const char   *line,
+                     gsize         len)
 {
-  char *line;
-  int   len;
   char *group;
   char *key;
   char *value;
 
-  line = kf->parse_buffer->str;
-  len  = kf->parse_buffer->len;
+  kf->context_group = kf->current_group;
+  kf->context_key = NULL;
 
   if (!kf->utf8_warning && !g_utf8_validate (line, len, NULL)) {
-    print_warning (kf, "file contains lines that are not UTF-8 encoded. There "
-                       "is no guarantee the validator will correctly work.\n");
+    print_warning (kf, DIAG_NOT_UTF8,
+                   "file contains lines that are not UTF-8 encoded. There "
+                   "is no guarantee the validator will correctly work.\n");
     kf->utf8_warning = TRUE;
   }
 
-  if (g_ascii_isspace (*line)) {
-    print_fatal (kf, "line \"%s\" starts with a space. Comment, group and "
-                     "key-value lines should not start with a space. The "
-                     "validation will continue, with the leading spaces "
-                     "ignored.\n", line);
-    while (g_ascii_isspace (*line))
+  /* a NUL byte ends the line, as far as the checks are concerned */
+  len = strnlen (line, len);
+
+  if (len > 0 && g_ascii_isspace (*line)) {
+    print_fatal (kf, DIAG_LINE_LEADING_SPACE,
+                 "line \"%.*s\" starts with a space. Comment, group and "
+                 "key-value lines should not start with a space. The "
+                 "validation will continue, with the leading spaces "
+                 "ignored.\n", (int) len, line);
+    while (len > 0 && g_ascii_isspace (*line)) {
       line++;
+      len--;
+    }
   }
 
-  if (validate_line_is_comment (kf, line))
+  if (validate_line_is_comment (kf, line, len))
     return;
 
   group = NULL;
-  if (validate_line_looks_like_group (kf, line, &group)) {
+  if (validate_line_looks_like_group (kf, line, len, &group)) {
+    kf->context_group = group;
+
     if (!kf->current_group &&
         (strcmp (group, GROUP_DESKTOP_ENTRY) &&
          strcmp (group, GROUP_KDE_DESKTOP_ENTRY)))
-      print_fatal (kf, "first group is not \"" GROUP_DESKTOP_ENTRY "\"\n");
+      print_fatal (kf, DIAG_FIRST_GROUP_NOT_DESKTOP_ENTRY,
+                   "first group is not \"" GROUP_DESKTOP_ENTRY "\"\n");
 
-    if (kf->current_group && strcmp (kf->current_group, group))
+    if (kf->current_group && strcmp (kf->current_group, group)) {
       validate_keys_for_current_group (kf);
+      kf->context_group = group;
+    }
 
     if (g_hash_table_lookup_extended (kf->groups, group, NULL, NULL)) {
-      print_fatal (kf, "file contains multiple groups named \"%s\", but "
-                       "multiple groups may not have the same name\n", group);
+      print_fatal (kf, DIAG_DUPLICATE_GROUP,
+                   "file contains multiple groups named \"%s\", but "
+                   "multiple groups may not have the same name\n", group);
     } else {
       validate_group_name (kf, group);
       g_hash_table_insert (kf->groups, g_strdup (group), NULL);
@@ -3077,7 +3394,7 @@ validate_parse_line (kf_validator *kf)
 
   key = NULL;
   value = NULL;
-  if (validate_line_looks_like_entry (kf, line, &key, &value)) {
+  if (validate_line_looks_like_entry (kf, line, len, &key, &value)) {
     if (kf->current_group) {
       GSList      *keys;
       kf_keyvalue *keyvalue;
@@ -3095,16 +3412,18 @@ validate_parse_line (kf_validator *kf)
       if (value)
         g_free (value);
 
-      print_fatal (kf, "file contains entry \"%s\" before the first group, "
-                       "but only comments are accepted before the first "
-                       "group\n", line);
+      print_fatal (kf, DIAG_ENTRY_BEFORE_FIRST_GROUP,
+                   "file contains entry \"%.*s\" before the first group, "
+                   "but only comments are accepted before the first "
+                   "group\n", (int) len, line);
     }
 
     return;
   }
 
-  print_fatal (kf, "file contains line \"%s\", which is not a comment, "
-                   "a group or an entry\n", line);
+  print_fatal (kf, DIAG_INVALID_LINE,
+               "file contains line \"%.*s\", which is not a comment, "
+               "a group or an entry\n", (int) len, line);
 }
 
 /* + Desktop entry files are encoded as lines of 8-bit characters separated by
@@ -3113,105 +3432,109 @@ validate_parse_line (kf_validator *kf)
  */
 static void
 validate_parse_data (kf_validator *kf,
-                     char         *data,
-                     int           length)
+                     const char   *data,
+                     gsize         length)
 {
-  int i;
-
-  for (i = 0; i < length; i++) {
-    if (data[i] == '\n') {
-      if (i > 0 && data[i - 1] == '\r') {
-        g_string_erase (kf->parse_buffer, kf->parse_buffer->len - 1, 1);
-
-        if (!kf->cr_error) {
-          print_fatal (kf, "file contains at least one line ending with a "
-                           "carriage return before the line feed, while lines "
-                           "should only be separated by a line feed "
-                           "character. First such line is: \"%s\"\n",
-                           kf->parse_buffer->str);
-          kf->cr_error = TRUE;
-        }
-      }
+  const char *p, *end, *eol, *next_lf, *next_cr;
+
+  p = data;
+  end = data + length;
+  next_lf = memchr (p, '\n', length);
+  next_cr = memchr (p, '\r', length);
+
+  /* find the end of each line without copying it; a carriage return is
+   * handled as a line feed */
+  while (p < end) {
+    if (next_lf != NULL && next_lf < p)
+      next_lf = memchr (p, '\n', end - p);
+    if (next_cr != NULL && next_cr < p)
+      next_cr = memchr (p, '\r', end - p);
+
+    eol = end;
+    if (next_lf != NULL)
+      eol = next_lf;
+    if (next_cr != NULL && next_cr < eol)
+      eol = next_cr;
+
+    if (eol == next_cr && !kf->cr_error) {
+      print_fatal (kf, DIAG_CARRIAGE_RETURN,
+                   "file contains at least one line ending with a "
+                   "carriage return, while lines should only be "
+                   "separated by a line feed character. First such "
+                   "line is: \"%.*s\"\n",
+                   (int) strnlen (p, eol - p), p);
+      kf->cr_error = TRUE;
+    }
 
-      if (kf->parse_buffer->len > 0) {
-        validate_parse_line (kf);
-        g_string_erase (kf->parse_buffer, 0, -1);
-      }
+    if (eol > p)
+      validate_parse_line (kf, p, eol - p);
 
-    } else if (data[i] == '\r') {
-        if (!kf->cr_error) {
-          print_fatal (kf, "file contains at least one line ending with a "
-                           "carriage return, while lines should only be "
-                           "separated by a line feed character. First such "
-                           "line is: \"%s\"\n", kf->parse_buffer->str);
-          kf->cr_error = TRUE;
-        }
-
-        data[i] = '\n';
-        i--;
-    } else
-      g_string_append_c (kf->parse_buffer, data[i]);
+    p = eol + 1;
   }
 }
 
 static void
-validate_flush_parse_buffer (kf_validator *kf)
+validate_finish_parse (kf_validator *kf)
 {
-  if (kf->parse_buffer->len > 0) {
-      validate_parse_line (kf);
-      g_string_erase (kf->parse_buffer, 0, -1);
-  }
-
   if (kf->current_group)
     validate_keys_for_current_group (kf);
 }
 
-#define VALIDATE_READ_SIZE 4096
+static void
+validate_parse_buffer (kf_validator *kf,
+                       const char   *data,
+                       gsize         length)
+{
+  if (length == 0) {
+    print_fatal (kf, DIAG_EMPTY_FILE,
+                 "file is empty\n");
+    return;
+  }
+
+  validate_parse_data (kf, data, length);
+  validate_finish_parse (kf);
+}
+
 static gboolean
 validate_parse_from_fd (kf_validator *kf,
                         int           fd)
 {
-  int         bytes_read;
-  struct stat stat_buf;
-  char        read_buf[VALIDATE_READ_SIZE];
+  DfuFileContents *contents;
+  GError          *error;
+  struct stat      stat_buf;
 
   if (fstat (fd, &stat_buf) < 0) {
-    print_fatal (kf, "while reading the file: %s\n", g_strerror (errno));
+    print_fatal (kf, DIAG_READ_ERROR,
+                 "while reading the file: %s\n", g_strerror (errno));
     return FALSE;
   }
 
   if (!S_ISREG (stat_buf.st_mode)) {
-    print_fatal (kf, "file is not a regular file\n");
+    print_fatal (kf, DIAG_NOT_A_REGULAR_FILE,
+                 "file is not a regular file\n");
     return FALSE;
   }
 
   if (stat_buf.st_size == 0) {
-    print_fatal (kf, "file is empty\n");
+    print_fatal (kf, DIAG_EMPTY_FILE,
+                 "file is empty\n");
     return FALSE;
   }
 
-  bytes_read = 0;
-  while (1) {
-    bytes_read = read (fd, read_buf, VALIDATE_READ_SIZE);
-
-    if (bytes_read == 0)  /* End of File */
-      break;
-
-    if (bytes_read < 0) {
-      if (errno == EINTR || errno == EAGAIN)
-        continue;
-
-      /* let's validate what we already have */
-      validate_flush_parse_buffer (kf);
+  error = NULL;
+  contents = dfu_file_contents_new_from_fd (fd, &error);
 
-      print_fatal (kf, "while reading the file: %s\n", g_strerror (errno));
-      return FALSE;
-    }
-
-    validate_parse_data (kf, read_buf, bytes_read);
+  if (contents == NULL) {
+    print_fatal (kf, DIAG_READ_ERROR,
+                 "while reading the file: %s\n", error->message);
+    g_error_free (error);
+    return FALSE;
   }
 
-  validate_flush_parse_buffer (kf);
+  validate_parse_buffer (kf,
+                         dfu_file_contents_get_data (contents),
+                         dfu_file_contents_get_length (contents));
+  dfu_file_contents_free (contents);
 
   return TRUE;
 }
@@ -3225,7 +3548,8 @@ validate_load_and_parse (kf_validator *kf)
   fd = g_open (kf->filename, O_RDONLY, 0);
 
   if (fd < 0) {
-    print_fatal (kf, "while reading the file: %s\n", g_strerror (errno));
+    print_fatal (kf, DIAG_READ_ERROR,
+                 "while reading the file: %s\n", g_strerror (errno));
     return FALSE;
   }
 
@@ -3259,84 +3583,511 @@ groups_hashtable_free (gpointer key,
   return TRUE;
 }
 
-gboolean
-desktop_file_validate (const char *filename,
-                       gboolean    warn_kde,
-                       gboolean    no_warn_deprecated,
-                       gboolean    no_hints)
+static void
+desktop_file_message_free (DesktopFileMessage *message)
 {
-  kf_validator kf;
+  g_free (message->group);
+  g_free (message->key);
+  g_free (message->message);
+  g_slice_free (DesktopFileMessage, message);
+}
 
+static void
+validator_init (kf_validator *kf,
+                const char   *filename,
+                gboolean      warn_kde,
+                gboolean      no_warn_deprecated,
+                gboolean      no_hints)
+{
   /* just a consistency check */
   g_assert (G_N_ELEMENTS (registered_types) == LAST_TYPE - 1);
 
-  kf.filename               = filename;
-  kf.parse_buffer           = g_string_new ("");
-  kf.utf8_warning           = FALSE;
-  kf.cr_error               = FALSE;
-  kf.current_group          = NULL;
-  kf.groups                 = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                     g_free, NULL);
-  kf.current_keys           = NULL;
-  kf.kde_reserved_warnings  = warn_kde;
-  kf.no_deprecated_warnings = no_warn_deprecated;
-  kf.no_hints               = no_hints;
-
-  kf.main_group       = NULL;
-  kf.type             = INVALID_TYPE;
-  kf.type_string      = NULL;
-  kf.show_in          = FALSE;
-  kf.application_keys = NULL;
-  kf.link_keys        = NULL;
-  kf.fsdevice_keys    = NULL;
-  kf.mimetype_keys    = NULL;
-  kf.interfaces       = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               NULL, g_free);
-  kf.action_values    = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               NULL, g_free);
-  kf.action_groups    = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                               NULL, g_free);
-  kf.fatal_error      = FALSE;
-#if GLIB_CHECK_VERSION(2, 50, 0)
-  kf.use_colors       = g_log_writer_supports_color (fileno (stdout));
-#else
-  kf.use_colors       = FALSE;
-#endif
-  kf.dbus_activatable = FALSE;
+  kf->filename               = filename;
+  kf->utf8_warning           = FALSE;
+  kf->cr_error               = FALSE;
+  kf->current_group          = NULL;
+  kf->groups                 = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, NULL);
+  kf->current_keys           = NULL;
+  kf->kde_reserved_warnings  = warn_kde;
+  kf->no_deprecated_warnings = no_warn_deprecated;
+  kf->no_hints               = no_hints;
+
+  kf->main_group       = NULL;
+  kf->type             = INVALID_TYPE;
+  kf->type_string      = NULL;
+  kf->show_in          = FALSE;
+  kf->application_keys = NULL;
+  kf->link_keys        = NULL;
+  kf->fsdevice_keys    = NULL;
+  kf->mimetype_keys    = NULL;
+  kf->interfaces       = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL, g_free);
+  kf->action_values    = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL, g_free);
+  kf->action_groups    = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                NULL, g_free);
+  kf->fatal_error      = FALSE;
+  kf->dbus_activatable = FALSE;
+  kf->messages         = g_ptr_array_new_with_free_func ((GDestroyNotify) desktop_file_message_free);
+  kf->context_group    = NULL;
+  kf->context_key      = NULL;
+}
+
+/* Runs the checks that need the whole file, and returns the result */
+static DesktopFileValidation *
+validator_finish (kf_validator *kf)
+{
+  DesktopFileValidation *validation;
 
-  validate_load_and_parse (&kf);
   //FIXME: this does not work well if there are both a Desktop Entry and a KDE
   //Desktop Entry groups since only the last one will be validated for this.
-  if (kf.main_group) {
-    validate_required_desktop_keys (&kf);
-    validate_type_keys (&kf);
-  }
-  validate_actions (&kf);
-  validate_filename (&kf);
-
-  g_list_foreach (kf.application_keys, (GFunc) g_free, NULL);
-  g_list_free (kf.application_keys);
-  g_list_foreach (kf.link_keys, (GFunc) g_free, NULL);
-  g_list_free (kf.link_keys);
-  g_list_foreach (kf.fsdevice_keys, (GFunc) g_free, NULL);
-  g_list_free (kf.fsdevice_keys);
-  g_list_foreach (kf.mimetype_keys, (GFunc) g_free, NULL);
-  g_list_free (kf.mimetype_keys);
-
-  g_hash_table_destroy (kf.interfaces);
-  g_hash_table_destroy (kf.action_values);
-  g_hash_table_destroy (kf.action_groups);
-
-  g_assert (kf.current_keys == NULL);
+  if (kf->main_group) {
+    validate_required_desktop_keys (kf);
+    validate_type_keys (kf);
+  }
+  validate_actions (kf);
+  validate_filename (kf);
+
+  g_list_foreach (kf->application_keys, (GFunc) g_free, NULL);
+  g_list_free (kf->application_keys);
+  g_list_foreach (kf->link_keys, (GFunc) g_free, NULL);
+  g_list_free (kf->link_keys);
+  g_list_foreach (kf->fsdevice_keys, (GFunc) g_free, NULL);
+  g_list_free (kf->fsdevice_keys);
+  g_list_foreach (kf->mimetype_keys, (GFunc) g_free, NULL);
+  g_list_free (kf->mimetype_keys);
+
+  g_hash_table_destroy (kf->interfaces);
+  g_hash_table_destroy (kf->action_values);
+  g_hash_table_destroy (kf->action_groups);
+
+  g_assert (kf->current_keys == NULL);
   /* we can't add an automatic destroy handler for the value because we replace
    * it when adding keys, and this means we'd have to copy the value each time
    * we replace it */
-  g_hash_table_foreach_remove (kf.groups, groups_hashtable_free, NULL);
-  g_hash_table_destroy (kf.groups);
-  g_free (kf.current_group);
-  g_string_free (kf.parse_buffer, TRUE);
+  g_hash_table_foreach_remove (kf->groups, groups_hashtable_free, NULL);
+  g_hash_table_destroy (kf->groups);
+  g_free (kf->current_group);
+
+  validation = g_slice_new (DesktopFileValidation);
+  validation->filename = g_strdup (kf->filename);
+  validation->valid    = !kf->fatal_error;
+  validation->messages = kf->messages;
+
+  return validation;
+}
+
+/* Validates the file and returns the messages, instead of printing them. The
+ * result must be freed with desktop_file_validation_free(). This is safe to
+ * call from several threads. */
+DesktopFileValidation *
+desktop_file_validation_run (const char *filename,
+                             gboolean    warn_kde,
+                             gboolean    no_warn_deprecated,
+                             gboolean    no_hints)
+{
+  kf_validator kf;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  validator_init (&kf, filename, warn_kde, no_warn_deprecated, no_hints);
+  validate_load_and_parse (&kf);
+
+  return validator_finish (&kf);
+}
+
+/* Same as desktop_file_validation_run(), but validates the @length bytes at
+ * @data, without any I/O. @filename is only used for the checks on the name
+ * of the file, and in the messages. */
+DesktopFileValidation *
+desktop_file_validation_run_data (const char *filename,
+                                  const char *data,
+                                  gsize       length,
+                                  gboolean    warn_kde,
+                                  gboolean    no_warn_deprecated,
+                                  gboolean    no_hints)
+{
+  kf_validator kf;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (data != NULL || length == 0, NULL);
+
+  validator_init (&kf, filename, warn_kde, no_warn_deprecated, no_hints);
+  validate_parse_buffer (&kf, data, length);
+
+  return validator_finish (&kf);
+}
+
+void
+desktop_file_validation_free (DesktopFileValidation *validation)
+{
+  if (validation == NULL)
+    return;
+
+  g_free (validation->filename);
+  g_ptr_array_unref (validation->messages);
+  g_slice_free (DesktopFileValidation, validation);
+}
+
+/* Escape values for console colors */
+#define UNDERLINE     "\033[4m"
+#define MAGENTA       "\033[35m"
+#define RED           "\033[31m"
+#define YELLOW        "\033[33m"
+
+/* Colour definitions */
+#define RESET_COLOR        (use_colors ? "\033[0m" : "")
+#define FILENAME_COLOR     (use_colors ? UNDERLINE : "")
+#define FATAL_COLOR        (use_colors ? RED : "")
+#define FUTURE_FATAL_COLOR (use_colors ? RED : "")
+#define WARNING_COLOR      (use_colors ? MAGENTA : "")
+#define HINT_COLOR         (use_colors ? YELLOW : "")
+
+/* One JSON object per line: file, group, key, severity, code and message */
+static void
+render_json_record (GString                  *output,
+                    const char               *filename,
+                    const DesktopFileMessage *message)
+{
+  static const char *severities[] = {
+    "error", "future-error", "warning", "hint"
+  };
+
+  g_string_append (output, "{\"file\":");
+  json_append_string (output, filename);
+  g_string_append (output, ",\"group\":");
+  json_append_string (output, message->group);
+  g_string_append (output, ",\"key\":");
+  json_append_string (output, message->key);
+  g_string_append_printf (output, ",\"severity\":\"%s\",\"code\":\"%s\","
+                                  "\"message\":",
+                          severities[message->severity],
+                          diagnostic_ids[message->code]);
+  json_append_string (output, message->message);
+  g_string_append (output, "}\n");
+}
+
+static void
+render_text_message (GString                  *output,
+                     const char               *filename,
+                     const DesktopFileMessage *message,
+                     gboolean                  use_colors)
+{
+  const char *color;
+  const char *label;
+  const char *note;
+
+  note = "";
+
+  switch (message->severity) {
+    case DESKTOP_FILE_SEVERITY_ERROR:
+      color = FATAL_COLOR;
+      label = "error";
+      break;
+    case DESKTOP_FILE_SEVERITY_FUTURE_ERROR:
+      color = FUTURE_FATAL_COLOR;
+      label = "error";
+      note = "(will be fatal in the future): ";
+      break;
+    case DESKTOP_FILE_SEVERITY_WARNING:
+      color = WARNING_COLOR;
+      label = "warning";
+      break;
+    case DESKTOP_FILE_SEVERITY_HINT:
+      color = HINT_COLOR;
+      label = "hint";
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+
+  g_string_append_printf (output, "%s%s%s: %s%s%s: %s%s\n",
+                          FILENAME_COLOR, filename, RESET_COLOR,
+                          color, label, RESET_COLOR, note, message->message);
+}
 
-  return (!kf.fatal_error);
+/* Appends the messages to @output, as printed by desktop-file-validate */
+void
+desktop_file_validation_render (DesktopFileValidation     *validation,
+                                DesktopFileValidateFormat  format,
+                                gboolean                   use_colors,
+                                GString                   *output)
+{
+  guint i;
+
+  g_return_if_fail (validation != NULL);
+  g_return_if_fail (output != NULL);
+
+  for (i = 0; i < validation->messages->len; i++) {
+    const DesktopFileMessage *message;
+
+    message = g_ptr_array_index (validation->messages, i);
+    if (format == DESKTOP_FILE_VALIDATE_FORMAT_JSONL)
+      render_json_record (output, validation->filename, message);
+    else
+      render_text_message (output, validation->filename, message, use_colors);
+  }
+}
+
+/* The results of the validation can be kept in a directory, so that a file
+ * that did not change is not validated again. Each entry of the cache is a
+ * file named after a SHA-256 hash of everything the output depends on: the
+ * version of the validator, the options, the name and the contents of the
+ * file. It contains the magic line, "1" or "0" on a line depending on whether
+ * the file is valid, and the messages as they were printed. */
+#define VALIDATE_CACHE_MAGIC "desktop-file-validate cache 1\n"
+
+static char *validate_cache_dir = NULL;
+
+/* Returns the contents of the file if it can be cached: errors while reading
+ * the file are not, and are reported by validate_load_and_parse() */
+static DfuFileContents *
+validate_cache_read_file (const char *filename)
+{
+  DfuFileContents *contents;
+  struct stat      stat_buf;
+  int              fd;
+
+  fd = g_open (filename, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  contents = NULL;
+  if (fstat (fd, &stat_buf) == 0 &&
+      S_ISREG (stat_buf.st_mode) && stat_buf.st_size > 0)
+    contents = dfu_file_contents_new_from_fd (fd, NULL);
+
+  close (fd);
+
+  return contents;
+}
+
+static char *
+validate_cache_get_path (const char                *filename,
+                         DfuFileContents           *contents,
+                         gboolean                   warn_kde,
+                         gboolean                   no_warn_deprecated,
+                         gboolean                   no_hints,
+                         DesktopFileValidateFormat  format,
+                         gboolean                   use_colors)
+{
+  GChecksum *checksum;
+  guchar     options[5];
+  char      *path;
+
+  options[0] = warn_kde;
+  options[1] = no_warn_deprecated;
+  options[2] = no_hints;
+  options[3] = format;
+  options[4] = use_colors;
+
+  /* the strings are hashed with their nul byte, to separate them */
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *) VERSION, sizeof (VERSION));
+  g_checksum_update (checksum, options, sizeof (options));
+  g_checksum_update (checksum, (const guchar *) filename,
+                     strlen (filename) + 1);
+  g_checksum_update (checksum,
+                     (const guchar *) dfu_file_contents_get_data (contents),
+                     dfu_file_contents_get_length (contents));
+
+  path = g_build_filename (validate_cache_dir,
+                           g_checksum_get_string (checksum), NULL);
+  g_checksum_free (checksum);
+
+  return path;
+}
+
+/* Appends the messages of the entry of the cache to @output, if there is a
+ * valid one */
+static gboolean
+validate_cache_replay (const char *path,
+                       GString    *output,
+                       gboolean   *valid)
+{
+  char  *data;
+  gsize  length;
+  gsize  header;
+
+  if (!g_file_get_contents (path, &data, &length, NULL))
+    return FALSE;
+
+  header = strlen (VALIDATE_CACHE_MAGIC);
+  if (length < header + 2 ||
+      strncmp (data, VALIDATE_CACHE_MAGIC, header) != 0 ||
+      (data[header] != '0' && data[header] != '1') ||
+      data[header + 1] != '\n') {
+    g_free (data);
+    return FALSE;
+  }
+
+  *valid = (data[header] == '1');
+  g_string_append_len (output, data + header + 2, length - header - 2);
+
+  g_free (data);
+
+  return TRUE;
+}
+
+/* Errors are ignored: the file will simply be validated again next time */
+static void
+validate_cache_store (const char *path,
+                      gboolean    valid,
+                      GString    *messages)
+{
+  GString *entry;
+
+  entry = g_string_new (VALIDATE_CACHE_MAGIC);
+  g_string_append (entry, valid ? "1\n" : "0\n");
+  g_string_append_len (entry, messages->str, messages->len);
+
+  g_file_set_contents (path, entry->str, entry->len, NULL);
+  g_string_free (entry, TRUE);
+}
+
+static gboolean
+validate_use_colors (void)
+{
+#if GLIB_CHECK_VERSION(2, 50, 0)
+  return g_log_writer_supports_color (fileno (stdout));
+#else
+  return FALSE;
+#endif
+}
+
+static gboolean
+validate_file (const char                *filename,
+               gboolean                   warn_kde,
+               gboolean                   no_warn_deprecated,
+               gboolean                   no_hints,
+               DesktopFileValidateFormat  format,
+               GString                   *output)
+{
+  DesktopFileValidation *validation;
+  DfuFileContents       *contents;
+  char                  *cache_path;
+  GString               *messages;
+  gboolean               use_colors;
+  gboolean               valid;
+
+  use_colors = validate_use_colors ();
+
+  contents   = NULL;
+  cache_path = NULL;
+  messages   = g_string_new (NULL);
+
+  if (validate_cache_dir)
+    contents = validate_cache_read_file (filename);
+
+  if (contents) {
+    cache_path = validate_cache_get_path (filename, contents,
+                                          warn_kde, no_warn_deprecated,
+                                          no_hints, format, use_colors);
+    if (validate_cache_replay (cache_path, messages, &valid))
+      goto out;
+  }
+
+  /* the file was already read to look up the cache */
+  if (contents)
+    validation = desktop_file_validation_run_data (filename,
+                                                   dfu_file_contents_get_data (contents),
+                                                   dfu_file_contents_get_length (contents),
+                                                   warn_kde, no_warn_deprecated,
+                                                   no_hints);
+  else
+    validation = desktop_file_validation_run (filename, warn_kde,
+                                              no_warn_deprecated, no_hints);
+
+  desktop_file_validation_render (validation, format, use_colors, messages);
+  valid = validation->valid;
+  desktop_file_validation_free (validation);
+
+  if (cache_path)
+    validate_cache_store (cache_path, valid, messages);
+
+out:
+  if (output)
+    g_string_append_len (output, messages->str, messages->len);
+  else if (messages->len > 0)
+    g_print ("%s", messages->str);
+
+  if (contents)
+    dfu_file_contents_free (contents);
+  g_free (cache_path);
+  g_string_free (messages, TRUE);
+
+  return valid;
+}
+
+gboolean
+desktop_file_validate (const char *filename,
+                       gboolean    warn_kde,
+                       gboolean    no_warn_deprecated,
+                       gboolean    no_hints)
+{
+  return validate_file (filename, warn_kde, no_warn_deprecated, no_hints,
+                        DESKTOP_FILE_VALIDATE_FORMAT_TEXT, NULL);
+}
+
+/* Same as desktop_file_validate(), but validates the @length bytes at @data
+ * instead of reading @filename */
+gboolean
+desktop_file_validate_data (const char *filename,
+                            const char *data,
+                            gsize       length,
+                            gboolean    warn_kde,
+                            gboolean    no_warn_deprecated,
+                            gboolean    no_hints)
+{
+  DesktopFileValidation *validation;
+  GString               *messages;
+  gboolean               valid;
+
+  validation = desktop_file_validation_run_data (filename, data, length,
+                                                 warn_kde, no_warn_deprecated,
+                                                 no_hints);
+  g_return_val_if_fail (validation != NULL, FALSE);
+
+  messages = g_string_new (NULL);
+  desktop_file_validation_render (validation,
+                                  DESKTOP_FILE_VALIDATE_FORMAT_TEXT,
+                                  validate_use_colors (), messages);
+  if (messages->len > 0)
+    g_print ("%s", messages->str);
+
+  valid = validation->valid;
+  g_string_free (messages, TRUE);
+  desktop_file_validation_free (validation);
+
+  return valid;
+}
+
+/* Same as desktop_file_validate(), but the messages are appended to @output,
+ * in the given format, instead of being printed. This is safe to call from
+ * several threads. */
+gboolean
+desktop_file_validate_to_string (const char                *filename,
+                                 gboolean                   warn_kde,
+                                 gboolean                   no_warn_deprecated,
+                                 gboolean                   no_hints,
+                                 DesktopFileValidateFormat  format,
+                                 GString                   *output)
+{
+  g_return_val_if_fail (output != NULL, FALSE);
+
+  return validate_file (filename, warn_kde, no_warn_deprecated, no_hints,
+                        format, output);
+}
+
+/* Makes desktop_file_validate() and desktop_file_validate_to_string() keep
+ * their results in @cache_dir, or not when it is %NULL. This must be called
+ * before validating files. */
+void
+desktop_file_validate_set_cache (const char *cache_dir)
+{
+  g_free (validate_cache_dir);
+  validate_cache_dir = g_strdup (cache_dir);
 }
 
 /* return FALSE if we were unable to fix the file */
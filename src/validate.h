@@ -35,10 +35,167 @@
 #define GROUP_KDE_DESKTOP_ENTRY "KDE Desktop Entry"
 #define GROUP_DESKTOP_ACTION "Desktop Action "
 
+typedef enum {
+  DESKTOP_FILE_VALIDATE_FORMAT_TEXT,
+  DESKTOP_FILE_VALIDATE_FORMAT_JSONL
+} DesktopFileValidateFormat;
+
+/* Every message of the validator has one of those codes. The codes and their
+ * identifiers (see desktop_file_diagnostic_get_id()) are stable: new codes
+ * are only added at the end, and several messages may share a code. */
+typedef enum {
+  DIAG_INVALID_STRING_VALUE,
+  DIAG_INVALID_LOCALESTRING_VALUE,
+  DIAG_MISSING_UNLOCALIZED_KEY,
+  DIAG_INVALID_BOOLEAN_VALUE,
+  DIAG_DEPRECATED_BOOLEAN_VALUE,
+  DIAG_INVALID_NUMERIC_VALUE,
+  DIAG_INVALID_LIST_VALUE,
+  DIAG_INVALID_LOCALESTRING_LIST_VALUE,
+  DIAG_UNREGISTERED_TYPE,
+  DIAG_KDE_RESERVED_TYPE,
+  DIAG_DEPRECATED_TYPE,
+  DIAG_UNKNOWN_VERSION,
+  DIAG_COMMENT_SAME_AS_NAME,
+  DIAG_ICON_IS_DIRECTORY,
+  DIAG_ICON_IS_RELATIVE_PATH,
+  DIAG_ICON_NAME_WITH_EXTENSION,
+  DIAG_BOTH_ONLY_SHOW_IN_AND_NOT_SHOW_IN,
+  DIAG_DUPLICATE_SHOW_IN_VALUE,
+  DIAG_UNREGISTERED_SHOW_IN_VALUE,
+  DIAG_INVALID_FIELD_CODE,
+  DIAG_ESCAPED_QUOTE_OUTSIDE_QUOTE,
+  DIAG_UNESCAPED_CHARACTER_IN_QUOTE,
+  DIAG_RESERVED_CHARACTER_OUTSIDE_QUOTE,
+  DIAG_INCOMPLETE_ESCAPE_SEQUENCE,
+  DIAG_MULTIPLE_FILE_FIELD_CODES,
+  DIAG_DEPRECATED_FIELD_CODE,
+  DIAG_UNCLOSED_QUOTE,
+  DIAG_INCOMPLETE_FIELD_CODE,
+  DIAG_NOT_AN_ABSOLUTE_PATH,
+  DIAG_DUPLICATE_MIME_TYPE,
+  DIAG_DISCOURAGED_MIME_TYPE,
+  DIAG_INVALID_MIME_TYPE,
+  DIAG_DUPLICATE_CATEGORY,
+  DIAG_UNREGISTERED_CATEGORY,
+  DIAG_MULTIPLE_MAIN_CATEGORIES,
+  DIAG_DEPRECATED_CATEGORY,
+  DIAG_RESERVED_CATEGORY_WITHOUT_ONLY_SHOW_IN,
+  DIAG_MISSING_RELATED_CATEGORY,
+  DIAG_CATEGORY_CAN_BE_EXTENDED,
+  DIAG_NO_MAIN_CATEGORY,
+  DIAG_EMPTY_KEYWORD,
+  DIAG_KEYWORD_SAME_AS_NAME,
+  DIAG_EMPTY_ACTION,
+  DIAG_DUPLICATE_ACTION,
+  DIAG_INVALID_ACTION_IDENTIFIER,
+  DIAG_INVALID_INTERFACE_NAME,
+  DIAG_DUPLICATE_INTERFACE,
+  DIAG_DBUS_FILENAME_NOT_REVERSE_DNS,
+  DIAG_UNREGISTERED_ENCODING,
+  DIAG_CONDITION_WITHOUT_PATH,
+  DIAG_CONDITION_WITH_ABSOLUTE_PATH,
+  DIAG_CONDITION_WITH_PARENT_PATH,
+  DIAG_CONDITION_TRAILING_SPACE,
+  DIAG_CONDITION_INVALID_FIRST_ARGUMENT,
+  DIAG_CONDITION_TOO_MANY_ARGUMENTS,
+  DIAG_CONDITION_TOO_FEW_ARGUMENTS,
+  DIAG_UNREGISTERED_CONDITION,
+  DIAG_KEY_NOT_LOCALIZABLE,
+  DIAG_DEPRECATED_KEY,
+  DIAG_KDE_RESERVED_KEY,
+  DIAG_UNREGISTERED_KEY,
+  DIAG_INVALID_KEY_NAME,
+  DIAG_DUPLICATE_KEY,
+  DIAG_INVALID_GROUP_NAME,
+  DIAG_REDUNDANT_GROUPS,
+  DIAG_DEPRECATED_GROUP,
+  DIAG_ACTION_GROUP_WITHOUT_NAME,
+  DIAG_UNREGISTERED_GROUP,
+  DIAG_MISSING_REQUIRED_KEY,
+  DIAG_MISSING_EXEC_KEY,
+  DIAG_RECOMMENDED_EXEC_KEY,
+  DIAG_KEY_NOT_VALID_FOR_TYPE,
+  DIAG_ACTION_WITHOUT_GROUP,
+  DIAG_ACTION_GROUP_WITHOUT_ACTION,
+  DIAG_INVALID_FILENAME_EXTENSION,
+  DIAG_DEPRECATED_FILENAME_EXTENSION,
+  DIAG_GROUP_TRAILING_SPACE,
+  DIAG_NOT_UTF8,
+  DIAG_LINE_LEADING_SPACE,
+  DIAG_FIRST_GROUP_NOT_DESKTOP_ENTRY,
+  DIAG_DUPLICATE_GROUP,
+  DIAG_ENTRY_BEFORE_FIRST_GROUP,
+  DIAG_INVALID_LINE,
+  DIAG_CARRIAGE_RETURN,
+  DIAG_READ_ERROR,
+  DIAG_NOT_A_REGULAR_FILE,
+  DIAG_EMPTY_FILE,
+  DIAG_LAST
+} DesktopFileDiagnostic;
+
+const char *desktop_file_diagnostic_get_id (DesktopFileDiagnostic code);
+
+typedef enum {
+  DESKTOP_FILE_SEVERITY_ERROR,
+  /* an error that is only a warning for now */
+  DESKTOP_FILE_SEVERITY_FUTURE_ERROR,
+  DESKTOP_FILE_SEVERITY_WARNING,
+  DESKTOP_FILE_SEVERITY_HINT
+} DesktopFileSeverity;
+
+/* A message of the validator. The group and the key are NULL when the message
+ * is not about a specific group or key. */
+typedef struct {
+  DesktopFileSeverity    severity;
+  DesktopFileDiagnostic  code;
+  char                  *group;
+  char                  *key;
+  char                  *message;
+} DesktopFileMessage;
+
+/* The result of the validation of a file: the file is valid when there is no
+ * message with the DESKTOP_FILE_SEVERITY_ERROR severity */
+typedef struct {
+  char      *filename;
+  gboolean   valid;
+  /* of DesktopFileMessage, in the order they were found */
+  GPtrArray *messages;
+} DesktopFileValidation;
+
+DesktopFileValidation *desktop_file_validation_run      (const char *filename,
+                                                         gboolean    warn_kde,
+                                                         gboolean    no_warn_deprecated,
+                                                         gboolean    no_hints);
+DesktopFileValidation *desktop_file_validation_run_data (const char *filename,
+                                                         const char *data,
+                                                         gsize       length,
+                                                         gboolean    warn_kde,
+                                                         gboolean    no_warn_deprecated,
+                                                         gboolean    no_hints);
+void                   desktop_file_validation_free     (DesktopFileValidation *validation);
+void                   desktop_file_validation_render   (DesktopFileValidation     *validation,
+                                                         DesktopFileValidateFormat  format,
+                                                         gboolean                   use_colors,
+                                                         GString                   *output);
+
 gboolean desktop_file_validate (const char *filename,
 				gboolean    warn_kde,
 				gboolean    no_warn_deprecated,
 				gboolean    no_hints);
+gboolean desktop_file_validate_data (const char *filename,
+                                     const char *data,
+                                     gsize       length,
+                                     gboolean    warn_kde,
+                                     gboolean    no_warn_deprecated,
+                                     gboolean    no_hints);
+gboolean desktop_file_validate_to_string (const char                *filename,
+                                         gboolean                   warn_kde,
+                                         gboolean                   no_warn_deprecated,
+                                         gboolean                   no_hints,
+                                         DesktopFileValidateFormat  format,
+                                         GString                   *output);
+void     desktop_file_validate_set_cache (const char *cache_dir);
 gboolean desktop_file_fixup    (GKeyFile   *keyfile,
                                 const char *filename);
 
@@ -27,11 +27,10 @@
  */
 
 #include <config.h>
+#include <errno.h>
 #include <locale.h>
-
-#ifdef HAVE_PLEDGE
+#include <string.h>
 #include <unistd.h>
-#endif
 
 #include "validate.h"
 
@@ -39,31 +38,251 @@ static gboolean   warn_kde = FALSE;
 static gboolean   no_hints = FALSE;
 static gboolean   no_warn_deprecated = FALSE;
 static gboolean   print_version = FALSE;
+static int        jobs = 1;
+static char     **recursive_dirs = NULL;
+static char      *files_from = NULL;
+static char      *output_format = NULL;
+static char      *cache_dir = NULL;
+static DesktopFileValidateFormat format = DESKTOP_FILE_VALIDATE_FORMAT_TEXT;
 static char     **filename = NULL;
 
 static GOptionEntry option_entries[] = {
   { "no-hints", 0, 0, G_OPTION_ARG_NONE, &no_hints, "Do not output hints to improve desktop file", NULL },
   { "no-warn-deprecated", 0, 0, G_OPTION_ARG_NONE, &no_warn_deprecated, "Do not warn about usage of deprecated items", NULL },
   { "warn-kde", 0, 0, G_OPTION_ARG_NONE, &warn_kde, "Warn if KDE extensions to the specification are used", NULL },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Validate files using N threads (0 for one per processor)", "N" },
+  { "recursive", 'r', 0, G_OPTION_ARG_FILENAME_ARRAY, &recursive_dirs, "Validate all .desktop and .directory files found in DIR and its subdirectories", "DIR" },
+  { "files-from", 0, 0, G_OPTION_ARG_FILENAME, &files_from, "Validate the files listed in FILE, one per line (- for the standard input)", "FILE" },
+  { "format", 0, 0, G_OPTION_ARG_STRING, &output_format, "Output format: \"text\" (default) or \"jsonl\" (one JSON object per diagnostic)", "FORMAT" },
+  { "cache", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir, "Keep the results in DIR, and reuse them for files that did not change", "DIR" },
   { "version", 0, 0, G_OPTION_ARG_NONE, &print_version, "Show the program version", NULL },
   { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filename, NULL, "<desktop-file>..." },
   { NULL }
 };
 
+/* A file being validated in a worker thread */
+typedef struct {
+  char       *filename;
+  GString    *output;
+  gboolean    exists;
+  gboolean    valid;
+  gboolean    done;
+} ValidateJob;
+
+/* Number of files that can be queued per thread, to bound the memory used by
+ * pending output when validating a very large number of files */
+#define JOBS_QUEUE_FACTOR 4
+
+static GMutex       jobs_mutex;
+static GCond        jobs_cond;
+static GThreadPool *jobs_pool = NULL;
+static GQueue       jobs_pending = G_QUEUE_INIT;
+static gboolean     all_valid = TRUE;
+
+static void
+validate_job (gpointer data,
+              gpointer user_data)
+{
+  ValidateJob *job = data;
+
+  job->exists = g_file_test (job->filename, G_FILE_TEST_IS_REGULAR);
+  if (job->exists)
+    job->valid = desktop_file_validate_to_string (job->filename, warn_kde,
+                                                  no_warn_deprecated, no_hints,
+                                                  format, job->output);
+
+  g_mutex_lock (&jobs_mutex);
+  job->done = TRUE;
+  g_cond_broadcast (&jobs_cond);
+  g_mutex_unlock (&jobs_mutex);
+}
+
+/* Waits for the job to be done and prints its output, so that the output is
+ * the same as when validating the files one after another */
+static void
+finish_job (ValidateJob *job)
+{
+  g_mutex_lock (&jobs_mutex);
+  while (!job->done)
+    g_cond_wait (&jobs_cond, &jobs_mutex);
+  g_mutex_unlock (&jobs_mutex);
+
+  if (!job->exists)
+    g_printerr ("%s: file does not exist\n", job->filename);
+  else if (job->output->len > 0)
+    g_print ("%s", job->output->str);
+
+  if (!job->exists || !job->valid)
+    all_valid = FALSE;
+
+  g_free (job->filename);
+  g_string_free (job->output, TRUE);
+  g_slice_free (ValidateJob, job);
+}
+
+static void
+finish_pending_jobs (void)
+{
+  while (!g_queue_is_empty (&jobs_pending))
+    finish_job (g_queue_pop_head (&jobs_pending));
+}
+
+static void
+validate_one_file (const char *file)
+{
+  ValidateJob *job;
+
+  if (jobs_pool == NULL && format == DESKTOP_FILE_VALIDATE_FORMAT_TEXT) {
+    if (!g_file_test (file, G_FILE_TEST_IS_REGULAR)) {
+      g_printerr ("%s: file does not exist\n", file);
+      all_valid = FALSE;
+    } else if (!desktop_file_validate (file, warn_kde, no_warn_deprecated, no_hints))
+      all_valid = FALSE;
+    return;
+  }
+
+  job = g_slice_new0 (ValidateJob);
+  job->filename = g_strdup (file);
+  job->output = g_string_new (NULL);
+
+  if (jobs_pool == NULL) {
+    validate_job (job, NULL);
+    finish_job (job);
+    return;
+  }
+
+  if (g_queue_get_length (&jobs_pending) >= (guint) jobs * JOBS_QUEUE_FACTOR)
+    finish_job (g_queue_pop_head (&jobs_pending));
+
+  g_queue_push_tail (&jobs_pending, job);
+  g_thread_pool_push (jobs_pool, job, NULL);
+}
+
+/* Errors about the input are printed after the output of the files that came
+ * before */
+G_GNUC_PRINTF (1, 2) static void
+input_error (const char *format, ...)
+{
+  va_list  args;
+  char    *str;
+
+  finish_pending_jobs ();
+
+  va_start (args, format);
+  str = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_printerr ("%s", str);
+  g_free (str);
+
+  all_valid = FALSE;
+}
+
+static gboolean
+has_desktop_file_suffix (const char *name)
+{
+  return (g_str_has_suffix (name, ".desktop") ||
+          g_str_has_suffix (name, ".directory"));
+}
+
+static int
+sort_names (const char **a,
+            const char **b)
+{
+  return strcmp (*a, *b);
+}
+
+/* Files are validated in alphabetical order, to get the same output on each
+ * run */
+static void
+validate_directory (const char *dir_path)
+{
+  GError     *error;
+  GDir       *dir;
+  const char *name;
+  GPtrArray  *names;
+  guint       i;
+
+  error = NULL;
+  dir = g_dir_open (dir_path, 0, &error);
+  if (dir == NULL) {
+    input_error ("%s: %s\n", dir_path, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir)) != NULL)
+    g_ptr_array_add (names, g_strdup (name));
+  g_dir_close (dir);
+
+  g_ptr_array_sort (names, (GCompareFunc) sort_names);
+
+  for (i = 0; i < names->len; i++) {
+    char *path;
+
+    name = g_ptr_array_index (names, i);
+    path = g_build_filename (dir_path, name, NULL);
+
+    /* do not follow symlinks to directories, to avoid loops */
+    if (g_file_test (path, G_FILE_TEST_IS_DIR)) {
+      if (!g_file_test (path, G_FILE_TEST_IS_SYMLINK))
+        validate_directory (path);
+    } else if (has_desktop_file_suffix (name))
+      validate_one_file (path);
+
+    g_free (path);
+  }
+
+  g_ptr_array_free (names, TRUE);
+}
+
+static void
+validate_files_from (const char *list)
+{
+  GIOChannel *channel;
+  GIOStatus   status;
+  GError     *error;
+  char       *line;
+  gsize       terminator_pos;
+
+  error = NULL;
+  if (strcmp (list, "-") == 0)
+    channel = g_io_channel_unix_new (STDIN_FILENO);
+  else
+    channel = g_io_channel_new_file (list, "r", &error);
+
+  if (channel == NULL) {
+    input_error ("%s: %s\n", list, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  /* file names are not necessarily UTF-8 */
+  g_io_channel_set_encoding (channel, NULL, NULL);
+
+  while ((status = g_io_channel_read_line (channel, &line, NULL,
+                                           &terminator_pos, &error)) == G_IO_STATUS_NORMAL) {
+    line[terminator_pos] = '\0';
+    if (line[0] != '\0')
+      validate_one_file (line);
+    g_free (line);
+  }
+
+  if (status == G_IO_STATUS_ERROR) {
+    input_error ("%s: %s\n", list, error->message);
+    g_error_free (error);
+  }
+
+  g_io_channel_unref (channel);
+}
+
 int
 main (int argc, char *argv[])
 {
   GOptionContext *context;
   GError         *error;
   int i;
-  gboolean all_valid;
-
-#ifdef HAVE_PLEDGE
-  if (pledge ("stdio rpath", NULL) == -1) {
-    g_printerr ("pledge\n");
-    return 1;
-  }
-#endif
 
   setlocale (LC_ALL, "");
 
@@ -86,25 +305,62 @@ main (int argc, char *argv[])
 
   g_option_context_free (context);
 
+#ifdef HAVE_PLEDGE
+  /* the cache is written to */
+  if (pledge (cache_dir ? "stdio rpath wpath cpath" : "stdio rpath", NULL) == -1) {
+    g_printerr ("pledge\n");
+    return 1;
+  }
+#endif
+
   if (print_version) {
     g_print("desktop-file-validate %s\n", VERSION);
     return 0;
   }
 
-  if (filename == NULL || filename[0] == NULL) {
+  if ((filename == NULL || filename[0] == NULL) &&
+      recursive_dirs == NULL && files_from == NULL) {
     g_printerr ("See \"%s --help\" for correct usage.\n", g_get_prgname ());
     return 1;
   }
 
-  all_valid = TRUE;
-  for (i = 0; filename[i]; i++) {
-    if (!g_file_test (filename[i], G_FILE_TEST_IS_REGULAR)) {
-      g_printerr ("%s: file does not exist\n", filename[i]);
-      all_valid = FALSE;
-    } else if (!desktop_file_validate (filename[i], warn_kde, no_warn_deprecated, no_hints))
-      all_valid = FALSE;
+  if (output_format == NULL || strcmp (output_format, "text") == 0)
+    format = DESKTOP_FILE_VALIDATE_FORMAT_TEXT;
+  else if (strcmp (output_format, "jsonl") == 0)
+    format = DESKTOP_FILE_VALIDATE_FORMAT_JSONL;
+  else {
+    g_printerr ("Unknown output format \"%s\"\n", output_format);
+    return 1;
+  }
+
+  /* the files are still validated without the cache */
+  if (cache_dir) {
+    if (g_mkdir_with_parents (cache_dir, 0755) < 0)
+      g_printerr ("Could not create cache directory \"%s\": %s\n",
+                  cache_dir, g_strerror (errno));
+    else
+      desktop_file_validate_set_cache (cache_dir);
   }
 
+  if (jobs <= 0)
+    jobs = g_get_num_processors ();
+
+  if (jobs > 1)
+    jobs_pool = g_thread_pool_new (validate_job, NULL, jobs, FALSE, NULL);
+
+  for (i = 0; filename && filename[i]; i++)
+    validate_one_file (filename[i]);
+
+  for (i = 0; recursive_dirs && recursive_dirs[i]; i++)
+    validate_directory (recursive_dirs[i]);
+
+  if (files_from)
+    validate_files_from (files_from);
+
+  finish_pending_jobs ();
+  if (jobs_pool)
+    g_thread_pool_free (jobs_pool, FALSE, TRUE);
+
   if (!all_valid)
     return 1;
 